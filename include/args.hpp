@@ -56,6 +56,12 @@ enum
     OP_TEST_COLORS,
     OP_RECURSIVE,
     OP_NOSAVE,
+    OP_REFRESH_RPC,
+    OP_STATS,
+    OP_LIMIT,
+    OP_AUR_CHANGES,
+    OP_REFRESH_METADATA,
+    OP_OFFLINE,
 };
 
 struct Operation_t
@@ -75,6 +81,9 @@ struct Operation_t
     u_short version;
     u_short test_colors;
     u_short show_recipe;
+    u_short show_stats;
+    u_short show_aur_changes;
+    u_short refresh_metadata;
 };
 
 inline struct Operation_t      op;
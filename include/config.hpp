@@ -44,6 +44,17 @@ struct _color_t
     fmt::rgb index;
 };
 
+// the keys "-Ss" results can be ranked by, see general.sortBy
+enum sort_key
+{
+    SORT_KEY_EXACT,
+    SORT_KEY_PREFIX,
+    SORT_KEY_POPULARITY,
+    SORT_KEY_VOTES,
+    SORT_KEY_INSTALLED,
+    SORT_KEY_NAME,
+};
+
 class Config
 {
 public:
@@ -51,18 +62,39 @@ public:
     alpm_list_t*             repos  = nullptr;
     std::string              makepkgBin;
     std::vector<std::string> editor;
+    std::vector<std::string> aurEndpoints;
+    std::vector<sort_key>    sortBy;
     path                     cacheDir;
     std::string              pmConfig;
     std::string              sudo;
     std::string              git;
     std::string              makepkgConf;
+    int                      maxConcurrentRequests;
+    int                      maxUrlLength;
+    int                      connectTimeout;
+    int                      requestTimeout;
+    int                      maxRetries;
+    int                      retryDelay;
+    int                      rpcBudget;
+    int                      prefetchCandidates;
+    int                      searchLimit;
+    int                      rpcSearchTTL;
+    int                      rpcInfoTTL;
+    int                      rpcMaxStale;
+    int                      aurListMaxAge;
+    int                      metadataMaxAge;
+    bool                     rpcStaleWhileRevalidate;
     bool                     aurOnly;
     bool                     useGit;
     bool                     colors;
     bool                     secretRecipe;
+    bool                     zeroCopySearch;
+    bool                     offline;
+    bool                     indexedSearch;
     bool                     debug;
     bool                     quiet;
     bool                     noconfirm;
+    bool                     refreshRpc = false;
     // alpm transaction flags
     int flags;
 
@@ -129,9 +161,85 @@ inline constexpr std::string_view AUTOCONFIG = R"#([general]
 # Available options: "name", "name-desc", "depends", "makedepends", "optdepends", "checkdepends"
 #searchBy = "name-desc"
 
+# If true (default), "-Ss" parses the AUR results in place and prints them straight from the response,
+# instead of copying every field of every package first.
+#zeroCopySearch = true
+
+# How "-Ss" results are ranked, from the most important key to the least.
+# Available keys: "exact" (the name is the query), "prefix" (the name starts with the query),
+# "popularity", "votes", "installed" and "name". An empty list keeps the order the AUR and the sync DBs return.
+#sortBy = ["exact", "prefix", "popularity", "votes", "installed"]
+
+# Show only the first N ranked results of "-Ss", 0 (default) shows all of them.
+# This option can be overrided with "--limit N".
+#searchLimit = 0
+
+# If true, taur never touches the network: searches and lookups are answered from the AUR metadata
+# stored by "--refresh-metadata" (however old it is), and from the repos already cloned in cacheDir.
+# This option can be overrided with "--offline".
+#offline = false
+
+# If true, "-Ss" searches trigram indexes of the AUR metadata stored by "--refresh-metadata" (cacheDir/aur.tri,
+# used while the metadata isn't older than cache.metadataMaxAge) and of the sync DBs (cacheDir/repos.tri, built by
+# "-Sy" and "--refresh-metadata", used while it matches them), instead of asking the AUR and scanning the sync DBs. The sync DBs give the same results as without it
+# (names, descriptions, provides and groups, ignoring the case), queries that are regexes or shorter than
+# 3 characters just scan them. The AUR is searched like the RPC does, but with plain substrings, not regexes.
+#indexedSearch = false
+
 # Where we are gonna download the AUR packages (default $XDG_CACHE_HOME/TabAUR, else ~/.cache/TabAUR)
 #cacheDir = "$XDG_CACHE_HOME/TabAUR"
 
+[aur]
+# The AUR instances to use, e.g a caching mirror, or a local one for testing.
+# With more than one, the fastest one that answers is picked on the first request,
+# and if it keeps failing, the next one is used instead.
+#endpoints = ["https://aur.archlinux.org"]
+
+[network]
+# How many AUR requests can be in flight at once, when looking up multiple packages.
+#maxConcurrentRequests = 8
+
+# The longest URL we send to the AUR, bigger package lists are split into multiple requests.
+#maxUrlLength = 4096
+
+# How many seconds to wait for a connection, and for a whole request, before giving up. 0 means no limit.
+#connectTimeout = 10
+#timeout = 60
+
+# AUR requests that fail because of the network, a server error (5xx) or rate limiting (429)
+# are retried up to this many times, waiting around retryDelay milliseconds (doubled on each retry) in between.
+#retries = 3
+#retryDelay = 500
+
+# How many AUR requests this IP may send per day. Requests are counted in cacheDir/rpc_budget,
+# and when less than a tenth is left, taur batches lookups and uses cached answers whatever their age.
+# Use "--stats" to see what's left. 0 disables the limit.
+#rpcBudget = 4000
+
+# When asked to pick one of multiple packages, how many of the most popular candidates get looked up
+# in the background while choosing (the most popular one also gets cloned, with useGit). 0 disables it.
+#prefetchCandidates = 3
+
+[cache]
+# AUR RPC responses are cached in cacheDir/rpc, so repeated searches and lookups don't query the AUR again.
+# How many seconds a search or info response stays fresh, 0 disables caching it.
+# Use "--refresh-rpc" to skip the cache for a single run.
+#searchTTL = 3600
+#infoTTL = 900
+
+# If true (default), an expired search response is used right away while it gets refreshed in the background,
+# as long as it's not older than maxStale seconds. Package info (e.g for "-Sua") is always refreshed once it expires.
+#staleWhileRevalidate = true
+#maxStale = 86400
+
+# After how many seconds the AUR package list (cacheDir/packages.aur) gets revalidated.
+# This is cheap when the list didn't change, so 0 (check on every run) is fine too.
+#aurListMaxAge = 86400
+
+# Package lookups are answered from the AUR metadata stored by "--refresh-metadata" (cacheDir/packages-meta.idx)
+# while it's younger than this many seconds, except for packages that aren't in it yet. 0 never uses it.
+#metadataMaxAge = 3600
+
 [bins]
 #makepkg = "makepkg"
 #git = "git"
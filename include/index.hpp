@@ -0,0 +1,447 @@
+#ifndef INDEX_HPP
+#define INDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <iterator>
+#include <fstream>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using std::filesystem::path;
+
+// a file mapped read-only, it stays valid even if the file gets replaced meanwhile
+class MappedFile
+{
+public:
+    MappedFile(const path& file_path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return static_cast<const char*>(mapping); }
+    size_t      size() const { return length; }
+
+private:
+    void*  mapping = nullptr;
+    size_t length  = 0;
+};
+
+/* Writes a file next to where it goes, and renames it over it on commit(), so readers never see half of it.
+ * If it's never committed, the temporary file is removed.
+ */
+class AtomicFileWriter
+{
+public:
+    std::ofstream out;
+
+    AtomicFileWriter(const path& file_path);
+    ~AtomicFileWriter();
+
+    bool commit();
+
+private:
+    path file_path, tmp_path;
+    bool committed = false;
+};
+
+/* cacheDir/packages.idx, the AUR package names of packages.aur sorted in a file that gets mmap'd instead of read.
+ * It's laid out as:
+ *   aur_index_header_t
+ *   uint32_t offsets[count + 1]       where each name starts in the blob, the last one is the blob size
+ *   char     blob[blob_size]          the names, back to back
+ *   (padding up to 4 bytes)
+ *   uint32_t displacements[buckets]   a minimal perfect hash of the names (CHD), see aur_index_slot()
+ *   uint32_t slots[count]             the sorted position of the name hashed to each slot
+ *   uint16_t fingerprints[count]      bits of the hash of that name, so most misses don't compare strings
+ * Everything is in native byte order, the index is rebuilt whenever it doesn't match.
+ */
+struct aur_index_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t blob_size;
+    uint32_t buckets;
+    uint32_t seed;  // the hash seed that made every bucket fit
+};
+
+inline constexpr char     AUR_INDEX_MAGIC[8] = "TAURIDX";
+inline constexpr uint32_t AUR_INDEX_VERSION  = 2;
+
+class AurIndex
+{
+public:
+    // maps file_path, the index is empty if it can't be read or isn't valid
+    AurIndex(const path& file_path);
+
+    AurIndex(const AurIndex&)            = delete;
+    AurIndex& operator=(const AurIndex&) = delete;
+
+    bool   valid() const { return header != nullptr; }
+    size_t size() const { return header ? header->count : 0; }
+
+    // the i-th name in sorted order, it points into the mapping
+    std::string_view at(const size_t i) const { return { blob + offsets[i], offsets[i + 1] - offsets[i] }; }
+
+    // one hash and at most one string compare
+    bool contains(const std::string_view name) const;
+    // binary search over the sorted names, what contains() did before the perfect hash
+    bool contains_sorted(const std::string_view name) const;
+
+private:
+    MappedFile                file;
+    const aur_index_header_t* header        = nullptr;
+    const uint32_t*           offsets       = nullptr;
+    const char*               blob          = nullptr;
+    const uint32_t*           displacements = nullptr;
+    const uint32_t*           slots         = nullptr;
+    const uint16_t*           fingerprints  = nullptr;
+};
+
+// the packages that appeared in and disappeared from the AUR between two package lists, both sorted
+struct AurIndexDiff_t
+{
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+    std::time_t              time = 0;  // when the newer list was fetched
+
+    bool empty() const { return added.empty() && removed.empty(); }
+};
+
+// collects the names of a package list, e.g while it downloads, then writes them as an index
+class AurIndexBuilder
+{
+public:
+    void           add(const std::string_view line);
+    AurIndexDiff_t diff(const AurIndex& previous);
+    bool           write(const path& index_path);
+
+private:
+    std::vector<std::string> names;
+    size_t                   blob_size = 0;
+    bool                     sorted    = false;
+
+    void sort();
+};
+
+/* cacheDir/provides.idx, what the AUR packages provide, from the AUR metadata dump (packages-meta-ext-v1.json.gz):
+ *   aur_provides_header_t
+ *   aur_provides_entry_t entries[count]   sorted by the provided name, then the package
+ *   char                 blob[blob_size]  the strings the entries point to
+ */
+struct aur_provides_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t blob_size;
+};
+
+// offsets and lengths of strings in the blob
+struct aur_provides_entry_t
+{
+    uint32_t name, name_len;
+    uint32_t pkg, pkg_len;
+    uint32_t version, version_len;  // empty if the provide isn't versioned
+};
+
+inline constexpr char     AUR_PROVIDES_MAGIC[8] = "TAURPRV";
+inline constexpr uint32_t AUR_PROVIDES_VERSION  = 1;
+
+class AurProvidesIndex
+{
+public:
+    // maps file_path, the index is empty if it can't be read or isn't valid
+    AurProvidesIndex(const path& file_path);
+
+    bool   valid() const { return header != nullptr; }
+    size_t size() const { return header ? header->count : 0; }
+
+    std::vector<std::string_view> providers(const std::string_view depend) const;
+
+private:
+    MappedFile                   file;
+    const aur_provides_header_t* header  = nullptr;
+    const aur_provides_entry_t*  entries = nullptr;
+    const char*                  blob    = nullptr;
+
+    std::string_view str(const uint32_t offset, const uint32_t len) const { return { blob + offset, len }; }
+};
+
+// collects what the packages of the metadata dump provide, then writes it as an index
+class AurProvidesBuilder
+{
+public:
+    void add(const std::string_view pkg, const std::string_view provide);
+    bool write(const path& index_path);
+
+private:
+    struct provide_t
+    {
+        std::string name, pkg, version;
+    };
+    std::vector<provide_t> provides;
+    size_t                 blob_size = 0;
+};
+
+// a package of the AUR metadata dump, as it gets ingested
+struct AurMetaPkg_t
+{
+    std::string              name;
+    std::string              version;
+    std::string              desc;
+    std::string              url;
+    std::string              url_path;
+    std::string              maintainer    = "\1";  // orphans have none
+    std::time_t              last_modified = 0;
+    std::time_t              outofdate     = 0;
+    float                    popularity    = 0;
+    float                    votes         = 0;
+    std::vector<std::string> licenses;
+    std::vector<std::string> depends;
+    std::vector<std::string> makedepends;
+    std::vector<std::string> provides;
+};
+
+/* cacheDir/packages-meta.idx, the AUR metadata dump stored by column, so a package is read without parsing anything.
+ * Rows are sorted by name, and every string is an offset of a null terminated string in the string table:
+ *   aur_meta_header_t
+ *   int64_t  last_modified[count], outofdate[count]
+ *   uint32_t name[count], version[count], desc[count], url[count], url_path[count], maintainer[count]
+ *   float    popularity[count], votes[count]
+ *   uint32_t licenses_index[count + 1], licenses[licenses_count]   the lists (CSR), the strings of row i are
+ *   uint32_t depends_index[count + 1], depends[depends_count]      list[index[i]] up to list[index[i + 1]]
+ *   uint32_t makedepends_index[count + 1], makedepends[makedepends_count]
+ *   char     strings[strings_size]   every distinct string once
+ */
+struct aur_meta_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint32_t licenses_count;
+    uint32_t depends_count;
+    uint32_t makedepends_count;
+    uint32_t reserved;
+    int64_t  snapshot;  // when the dump was downloaded
+    uint64_t strings_size;
+};
+
+inline constexpr char     AUR_META_MAGIC[8] = "TAURMET";
+inline constexpr uint32_t AUR_META_VERSION  = 1;
+
+// a list of strings of a row of AurMetaStore, it points into the mapping
+class AurMetaList
+{
+public:
+    class iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = std::string_view;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = void;
+        using reference         = std::string_view;
+
+        iterator() = default;
+        iterator(const uint32_t* ref, const char* strings) : ref(ref), strings(strings) {}
+
+        std::string_view operator*() const { return strings + *ref; }
+        iterator&        operator++() { ref++; return *this; }
+        iterator         operator++(int) { iterator it = *this; ref++; return it; }
+        bool             operator==(const iterator& other) const { return ref == other.ref; }
+
+    private:
+        const uint32_t* ref     = nullptr;
+        const char*     strings = nullptr;
+    };
+
+    AurMetaList(const uint32_t* first, const uint32_t* last, const char* strings) : first(first), last(last), strings(strings) {}
+
+    iterator begin() const { return { first, strings }; }
+    iterator end() const { return { last, strings }; }
+    size_t   size() const { return last - first; }
+
+private:
+    const uint32_t *first, *last;
+    const char*     strings;
+};
+
+class AurMetaStore
+{
+public:
+    // maps file_path, the store is empty if it can't be read or isn't valid
+    AurMetaStore(const path& file_path);
+
+    bool        valid() const { return header != nullptr; }
+    size_t      size() const { return header ? header->count : 0; }
+    std::time_t snapshot() const { return header ? header->snapshot : 0; }
+
+    // the row of a package, binary searched by name
+    std::optional<size_t> find(const std::string_view name) const;
+
+    std::string_view name(const size_t i) const { return strings + name_col[i]; }
+    std::string_view version(const size_t i) const { return strings + version_col[i]; }
+    std::string_view desc(const size_t i) const { return strings + desc_col[i]; }
+    std::string_view url(const size_t i) const { return strings + url_col[i]; }
+    std::string_view url_path(const size_t i) const { return strings + url_path_col[i]; }
+    std::string_view maintainer(const size_t i) const { return strings + maintainer_col[i]; }
+    std::time_t      last_modified(const size_t i) const { return last_modified_col[i]; }
+    std::time_t      outofdate(const size_t i) const { return outofdate_col[i]; }
+    float            popularity(const size_t i) const { return popularity_col[i]; }
+    float            votes(const size_t i) const { return votes_col[i]; }
+    AurMetaList      licenses(const size_t i) const { return list(licenses_index, licenses_list, i); }
+    AurMetaList      depends(const size_t i) const { return list(depends_index, depends_list, i); }
+    AurMetaList      makedepends(const size_t i) const { return list(makedepends_index, makedepends_list, i); }
+
+private:
+    MappedFile               file;
+    const aur_meta_header_t* header            = nullptr;
+    const int64_t*           last_modified_col = nullptr;
+    const int64_t*           outofdate_col     = nullptr;
+    const uint32_t*          name_col          = nullptr;
+    const uint32_t*          version_col       = nullptr;
+    const uint32_t*          desc_col          = nullptr;
+    const uint32_t*          url_col           = nullptr;
+    const uint32_t*          url_path_col      = nullptr;
+    const uint32_t*          maintainer_col    = nullptr;
+    const float*             popularity_col    = nullptr;
+    const float*             votes_col         = nullptr;
+    const uint32_t*          licenses_index    = nullptr;
+    const uint32_t*          licenses_list     = nullptr;
+    const uint32_t*          depends_index     = nullptr;
+    const uint32_t*          depends_list      = nullptr;
+    const uint32_t*          makedepends_index = nullptr;
+    const uint32_t*          makedepends_list  = nullptr;
+    const char*              strings           = nullptr;
+
+    AurMetaList list(const uint32_t* index, const uint32_t* refs, const size_t i) const
+    {
+        return { refs + index[i], refs + index[i + 1], strings };
+    }
+};
+
+// collects the packages of the metadata dump, then writes them as a store
+class AurMetaBuilder
+{
+public:
+    void add(const AurMetaPkg_t& pkg);
+    bool write(const path& store_path, const std::time_t snapshot);
+
+private:
+    struct row_t
+    {
+        uint32_t                  name, version, desc, url, url_path, maintainer;
+        std::time_t               last_modified, outofdate;
+        float                     popularity, votes;
+        std::pair<size_t, size_t> licenses, depends, makedepends;  // [begin, end) in the lists below
+    };
+
+    std::vector<row_t>                        rows;
+    std::vector<uint32_t>                     licenses, depends, makedepends;
+    std::string                               strings = std::string(1, '\0');  // "" is at offset 0
+    std::unordered_map<std::string, uint32_t> string_offsets;
+
+    uint32_t intern(const std::string& str);
+};
+
+/* A trigram index for substring searches, e.g cacheDir/aur.tri over the packages of packages-meta.idx.
+ * Every 3 bytes of the texts of a document (lowercased) are a trigram, and each trigram has the sorted list of the documents
+ * that have it. A query can only match the documents in all the lists of its trigrams, they still have to be checked.
+ *   trigram_index_header_t
+ *   uint64_t offsets[trigrams + 1]  where the list of each trigram starts in postings, the last one is postings_size
+ *   uint32_t keys[trigrams]         the trigrams, sorted, as (b0 << 16 | b1 << 8 | b2)
+ *   uint32_t counts[trigrams]       how many documents each list has
+ *   uint32_t doc_offsets[docs + 1]  where the key of each document starts in doc_keys, if there are keys
+ *   uint8_t  postings[postings_size]  the lists, as the differences between document numbers, in LEB128 varints
+ *   char     doc_keys[doc_keys_size]
+ */
+struct trigram_index_header_t
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t trigrams;
+    uint32_t docs;
+    uint32_t reserved;
+    uint64_t stamp;  // what it was built from, to tell whether it's stale (e.g the snapshot time of packages-meta.idx)
+    uint64_t postings_size;
+    uint64_t doc_keys_size;
+};
+
+inline constexpr char     TRIGRAM_INDEX_MAGIC[8] = "TAURTRI";
+inline constexpr uint32_t TRIGRAM_INDEX_VERSION  = 1;
+
+class TrigramIndex
+{
+public:
+    // maps file_path, the index is empty if it can't be read or isn't valid
+    TrigramIndex(const path& file_path);
+
+    bool     valid() const { return header != nullptr; }
+    size_t   docs() const { return header ? header->docs : 0; }
+    uint64_t stamp() const { return header ? header->stamp : 0; }
+
+    // the key a document was added with, empty if the index has no keys
+    std::string_view doc_key(const size_t doc) const
+    {
+        return doc_offsets ? std::string_view(doc_keys + doc_offsets[doc], doc_offsets[doc + 1] - doc_offsets[doc]) : std::string_view();
+    }
+
+    // the documents that have every trigram of query, sorted.
+    // nothing if the query is too short to have a trigram, then every document could match
+    std::optional<std::vector<uint32_t>> candidates(const std::string_view query) const;
+
+private:
+    MappedFile                    file;
+    const trigram_index_header_t* header      = nullptr;
+    const uint64_t*               offsets     = nullptr;
+    const uint32_t*               keys        = nullptr;
+    const uint32_t*               counts      = nullptr;
+    const uint32_t*               doc_offsets = nullptr;
+    const uint8_t*                postings    = nullptr;
+    const char*                   doc_keys    = nullptr;
+};
+
+class TrigramIndexBuilder
+{
+public:
+    // adds the next document, documents are numbered from 0 in the order they're added
+    void add(const std::string_view key, std::span<const std::string_view> texts);
+    void add(const std::string_view key, std::initializer_list<std::string_view> texts)
+    { this->add(key, std::span(texts.begin(), texts.size())); }
+    bool write(const path& index_path, const uint64_t stamp);
+
+private:
+    std::unordered_map<uint32_t, std::vector<uint32_t>> lists;
+    std::vector<uint32_t>                               doc_offsets = { 0 };
+    std::string                                         doc_keys;
+    std::vector<uint32_t>                               doc_trigrams;  // reused by add()
+};
+
+bool                            build_aur_index(const path& list_path, const path& index_path);
+void                            reload_aur_index();
+bool                            write_aur_changes(const AurIndexDiff_t& diff, const path& changes_path);
+std::optional<AurIndexDiff_t>   read_aur_changes(const path& changes_path);
+std::shared_ptr<const AurIndex> aur_index();
+
+std::shared_ptr<const AurProvidesIndex> aur_provides_index();
+void                                    reload_aur_provides_index();
+
+std::shared_ptr<const AurMetaStore> aur_meta_store();
+void                                reload_aur_meta_store();
+
+// the trigram index cacheDir/<name>, mapped once per process (until it's reloaded)
+std::shared_ptr<const TrigramIndex> search_index(const std::string& name);
+void                                reload_search_index(const std::string& name);
+
+#endif
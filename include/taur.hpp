@@ -4,16 +4,25 @@
 #include <alpm.h>
 #include <alpm_list.h>
 #include <fcntl.h>
-#include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <optional>
+#include <span>
+#include <stop_token>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "cpr/cpr.h"
+#include "index.hpp"
 #include "util.hpp"
 
 class Config;
@@ -44,29 +53,256 @@ struct TaurPkg_t
     alpm_list_t* depends_list;
 };
 
+// which fields of a TaurPkg_t an AUR lookup fills in, see TaurBackend::fetch_pkgs()
+enum pkg_fields
+{
+    PKG_FIELD_NAME          = 1 << 0,
+    PKG_FIELD_VERSION       = 1 << 1,
+    PKG_FIELD_AUR_URL       = 1 << 2,  // needs PKG_FIELD_NAME for .git urls
+    PKG_FIELD_URL           = 1 << 3,
+    PKG_FIELD_DESC          = 1 << 4,
+    PKG_FIELD_MAINTAINER    = 1 << 5,
+    PKG_FIELD_LAST_MODIFIED = 1 << 6,
+    PKG_FIELD_OUTOFDATE     = 1 << 7,
+    PKG_FIELD_POPULARITY    = 1 << 8,
+    PKG_FIELD_VOTES         = 1 << 9,
+    PKG_FIELD_LICENSES      = 1 << 10,
+    PKG_FIELD_MAKEDEPENDS   = 1 << 11,
+    PKG_FIELD_DEPENDS       = 1 << 12,  // with PKG_FIELD_MAKEDEPENDS, totaldepends too
+    PKG_FIELD_INSTALLED     = 1 << 13,
+
+    PKG_FIELDS_ALL = ~0,
+    // enough to tell if an installed package has an upgrade, and to download it
+    PKG_FIELDS_UPGRADE_CHECK = PKG_FIELD_NAME | PKG_FIELD_VERSION | PKG_FIELD_AUR_URL | PKG_FIELD_LAST_MODIFIED,
+};
+
+/* A package from an AUR RPC response that was parsed in place, every string points into the response buffer.
+ * It's only valid as long as the RpcView_t it came from.
+ */
+struct TaurPkgView_t
+{
+    std::string_view                  name;
+    std::string_view                  version;
+    std::string_view                  url;
+    std::string_view                  url_path;  // the aur_url without the AUR endpoint
+    std::string_view                  desc;
+    std::string_view                  maintainer;
+    time_t                            last_modified = 0;
+    time_t                            outofdate     = 0;
+    float                             popularity    = 1;
+    float                             votes         = 0;
+    std::span<const std::string_view> licenses;
+    std::span<const std::string_view> makedepends;
+    std::span<const std::string_view> depends;
+    bool                              installed = false;
+};
+
+// the result of a transfer made by TaurBackend::http_get_multi()
+struct HttpResponse_t
+{
+    std::string url;
+    std::string text;
+    std::string error;  // empty if the transfer itself succeeded
+    long        status_code = 0;
+    double      elapsed     = 0;  // seconds, retries included
+    int         retries     = 0;
+    bool        retry       = true;  // whether http_perform_multi() may retry it
+    bool        cached      = false;
+
+    // if set, the body is handed to this as it arrives instead of being stored in text
+    std::function<void(std::string_view)> on_data;
+    // if set, the transfer is paused while it returns false, so on_data isn't handed more than it can keep up with
+    std::function<bool()> ready;
+    // if set, called once the transfer is done for good (it's not going to be retried)
+    std::function<void()> on_done;
+    // the transfer is cancelled once a stop is requested on this
+    std::stop_token stop;
+};
+
+// the packages of an AUR RPC response, decoded by TaurBackend::rpc_get() while it downloads
+struct RpcResult_t
+{
+    std::vector<TaurPkg_t> pkgs;
+    std::string            type;   // "error" if the AUR refused the request
+    std::string            error;
+    long                   status_code = 0;
+    double                 elapsed     = 0;  // seconds
+    bool                   cached      = false;
+};
+
+// an AUR RPC response parsed in place by TaurBackend::rpc_get_view(), it owns what the package views point to.
+struct RpcView_t
+{
+    std::unique_ptr<std::string>  buffer;  // behind a pointer, so moving this never moves the data
+    std::vector<std::string_view> lists;   // the depends, makedepends and licenses of every package
+    std::vector<TaurPkgView_t>    pkgs;
+    std::shared_ptr<const void>   owner;  // keeps what the views point to alive, when it's not buffer (e.g the metadata store)
+    std::string                   type;
+    std::string                   error;
+    long                          status_code = 0;
+    bool                          cached      = false;
+};
+
+// the "-Ss" results of a query, see TaurBackend::search_ranked()
+struct SearchResults_t
+{
+    RpcView_t              aur;
+    std::vector<TaurPkg_t> repos;
+    // the order to show them in, cut to config->searchLimit: {true, i} is aur.pkgs[i], {false, i} is repos[i]
+    std::vector<std::pair<bool, size_t>> ranked;
+};
+
+/* Orders "-Ss" results by the keys in config->sortBy, the first key that differs decides.
+ * It compares TaurPkg_t and TaurPkgView_t alike, so AUR views and sync DB packages can be merged.
+ */
+struct PkgRanking_t
+{
+    std::string_view query;
+
+    // @return true if a ranks before b
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        for (const sort_key key : config->sortBy)
+        {
+            int cmp = 0;
+            switch (key)
+            {
+                case SORT_KEY_EXACT:      cmp = (a.name == query) - (b.name == query); break;
+                case SORT_KEY_PREFIX:     cmp = hasStart(a.name, query) - hasStart(b.name, query); break;
+                case SORT_KEY_POPULARITY: cmp = (a.popularity > b.popularity) - (a.popularity < b.popularity); break;
+                case SORT_KEY_VOTES:      cmp = (a.votes > b.votes) - (a.votes < b.votes); break;
+                case SORT_KEY_INSTALLED:  cmp = a.installed - b.installed; break;
+                case SORT_KEY_NAME:       cmp = std::string_view(b.name).compare(a.name); break;  // a-z
+            }
+
+            if (cmp != 0)
+                return cmp > 0;
+        }
+
+        return false;
+    }
+};
+
+/** Ranks search results with PkgRanking_t, and drops everything after the first limit ones.
+ * With a limit only the kept results get sorted (partial sort), the others are left unordered and erased.
+ * @param pkgs the results, ranked in place
+ * @param query what was searched for
+ * @param limit how many results to keep, 0 for all of them
+ */
+template <typename Pkg_t>
+void rankSearchResults(std::vector<Pkg_t>& pkgs, const std::string_view query, const size_t limit)
+{
+    const PkgRanking_t ranking{ query };
+
+    if (limit > 0 && limit < pkgs.size())
+    {
+        if (!config->sortBy.empty())
+            std::partial_sort(pkgs.begin(), pkgs.begin() + limit, pkgs.end(), ranking);
+        pkgs.erase(pkgs.begin() + limit, pkgs.end());
+    }
+    else if (!config->sortBy.empty())
+        std::stable_sort(pkgs.begin(), pkgs.end(), ranking);
+}
+
 class TaurBackend
 {
 public:
     Config& config;
     TaurBackend(Config& cfg);
-    // They are different because we found that fetching each AUR pkg is very time consuming, so we store the name and
-    // look it up later.
-    std::vector<TaurPkg_t>   getPkgFromJson(const rapidjson::Document& doc, const bool useGit);
+    ~TaurBackend();
     std::vector<TaurPkg_t>   search_pac(const std::string_view query);
     std::vector<TaurPkg_t>   search(const std::string_view query, const bool useGit, const bool aurOnly, const bool checkExactMatch = true);
+    RpcView_t                search_view(const std::string_view query);
+    SearchResults_t          search_ranked(const std::string_view query, const bool aurOnly);
     bool                     download_tar(const std::string_view url, const path& out_path);
     bool                     download_git(const std::string_view url, const path& out_path);
     bool                     download_pkg(const std::string_view url, const path out_path);
+    std::future<bool>        prefetch_git(const std::string& url, const path& out_path, std::stop_token stop = {});
     std::optional<TaurPkg_t> fetch_pkg(const std::string_view pkg, const bool returnGit);
-    std::vector<TaurPkg_t>   fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit);
+    std::vector<TaurPkg_t>   fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit, const int fields = PKG_FIELDS_ALL,
+                                        std::stop_token stop = {});
+    std::future<std::vector<TaurPkg_t>> fetch_pkgs_async(std::vector<std::string> pkgs, const bool returnGit);
     bool                     remove_pkgs(const alpm_list_smart_pointer& pkgs);
     bool                     remove_pkg(alpm_pkg_t* pkgs, const bool ownTransaction = true);
     bool                     handle_aur_depends(const TaurPkg_t& pkg, const path& out_path, std::vector<TaurPkg_t> const& localPkgs, const bool useGit);
     bool                     build_pkg(const std::string_view pkg_name, const std::string_view extracted_path, const bool alreadyprepared);
     bool                     update_all_aur_pkgs(const path& cacheDir, const bool useGit);
+    bool                     update_aur_metadata();
+    bool                     update_repos_search_index();
     std::vector<TaurPkg_t>   get_all_local_pkgs(const bool aurOnly);
+    std::string              aur_url();
+    size_t                   rpc_budget_used();
+    bool                     rpc_budget_low();
+    std::string              failover_url(const std::string& url);
+    cpr::Response               http_get(const std::string_view url, const cpr::Header& headers = {},
+                                         const std::function<bool(std::string_view)>& on_data = nullptr);
+    std::vector<HttpResponse_t> http_get_multi(std::vector<std::string> const& urls);
+    void                        http_perform_multi(std::vector<HttpResponse_t>& transfers);
+    std::vector<RpcResult_t>    rpc_get(std::vector<std::string> const& urls, const int ttl, const bool returnGit, const int fields = PKG_FIELDS_ALL,
+                                        std::stop_token stop = {});
+    RpcView_t                   rpc_get_view(const std::string& url, const int ttl);
+
+private:
+    // every request goes through sessions attached to this share handle,
+    // so they all use the same connection pool, DNS cache and TLS sessions.
+    CURLSH*              curl_share;
+    std::mutex           curl_share_locks[CURL_LOCK_DATA_LAST];
+    std::atomic<size_t>  net_requests = 0, net_reused = 0, net_retries = 0;
+    std::atomic<int64_t> net_retry_wait_ms = 0;
+    std::atomic<bool>    rpc_budget_warned = false;
+
+    // the AUR endpoints from config.aurEndpoints, the one in front is used.
+    // if there's more than one, they get sorted by latency on first use
+    std::vector<std::string> endpoints;
+    std::mutex               endpoints_mutex;
+    std::once_flag           endpoints_probed;
+
+    // the packages looked up during this run, by returnGit and name, shared by every caller.
+    // an empty optional means the AUR doesn't have it
+    std::unordered_map<std::string, std::shared_future<std::optional<TaurPkg_t>>> pkg_lookups;
+    std::mutex                                                                    pkg_lookups_mutex;
+    std::atomic<size_t>                                                           lookups_saved = 0;
+
+    // the staleness of the stored AUR metadata is reported once, when it's first used offline
+    std::once_flag offline_reported;
+
+    // libalpm isn't thread safe, so calls that can happen on worker threads (e.g searches) take this
+    std::mutex alpm_mutex;
+
+    // the repos prefetch_git() just cloned, download_git() doesn't pull them again
+    std::unordered_set<std::string> fresh_clones;
+    std::mutex                      fresh_clones_mutex;
+
+    // background refreshes of stale RPC cache entries, waited for on destruction
+    std::vector<std::future<void>> rpc_refreshes;
+    std::mutex                     rpc_refreshes_mutex;
+
+    void setup_session(cpr::Session& session, const std::string_view url);
+    void count_connection(CURL* handle);
+    void probe_endpoints();
+    void record_rpc_requests(const size_t requests);
+    std::vector<std::string> resolve_aur_depends(std::vector<std::string> const& depends, const AurIndex& index, const bool useGit);
+    std::shared_ptr<const AurMetaStore> usable_meta_store();
+    std::optional<std::vector<size_t>>  search_snapshot(const std::string_view query, std::shared_ptr<const AurMetaStore>& store);
+    std::vector<TaurPkg_t> fetch_pkgs_snapshot(std::vector<std::string>& pkgs, const bool returnGit);
+    std::vector<TaurPkg_t> fetch_pkgs_chunked(std::vector<std::string> const& pkgs, const bool returnGit, const int fields,
+                                              std::vector<std::string>* failed = nullptr, std::stop_token stop = {});
+    std::vector<TaurPkg_t> lookup_memoized(std::vector<std::string> const& pkgs, const bool returnGit,
+                                           const std::function<std::vector<TaurPkg_t>(std::vector<std::string> const&, std::vector<std::string>&)>& fetch);
+    std::optional<std::chrono::milliseconds> plan_retry(const int attempt, const std::string_view url, const std::string_view reason);
 };
 
+RpcResult_t parseRpcChunks(std::span<const std::string_view> chunks, const bool returnGit, const int fields, const std::string_view base_url);
+bool        parseRpcView(RpcView_t& out);
+
+std::vector<std::string> splitInfoUrls(const std::string_view base_url, std::vector<std::string> const& pkgs, const size_t maxLen,
+                                       std::vector<size_t>& chunkSizes);
+
+// the ETag and Last-Modified of a download, see download_aur_cache()
+cpr::Header readValidators(const path& validators_path);
+void        writeValidators(const path& validators_path, const cpr::Response& r);
+
 inline std::string built_pkg, pkgs_to_install, pkgs_failed_to_build;
 
 #endif
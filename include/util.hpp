@@ -1,12 +1,17 @@
 #ifndef UTIL_HPP
 #define UTIL_HPP
 
+#include <zlib.h>
+
 #include <array>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -27,14 +32,15 @@
 #endif
 
 struct TaurPkg_t;
+struct TaurPkgView_t;
 class TaurBackend;
 
 #define BOLD fmt::emphasis::bold
 #define BOLD_COLOR(x) (fmt::emphasis::bold | fmt::fg(x))
 #define NOCOLOR "\033[0m"
-#define AUR_URL "https://aur.archlinux.org"
-#define AUR_URL_GIT(x) fmt::format("https://aur.archlinux.org/{}.git", x)
-#define AUR_URL_TAR(x) fmt::format("https://aur.archlinux.org/cgit/aur.git/snapshot/{}.tar.gz", x)
+// base is the AUR endpoint to use, see TaurBackend::aur_url()
+#define AUR_URL_GIT(base, x) fmt::format("{}/{}.git", base, x)
+#define AUR_URL_TAR(base, x) fmt::format("{}/cgit/aur.git/snapshot/{}.tar.gz", base, x)
 
 #define alpm_list_smart_pointer std::unique_ptr<alpm_list_t, decltype(&alpm_list_free)>
 #define make_list_smart_pointer(pointer) \
@@ -89,17 +95,50 @@ enum log_level
     NONE  // display no prefix for this.
 };
 
+// CTRL-C while network transfers are running only sets net_interrupted,
+// so they abort and clean up first, then the main thread exits (see interruptHandler() and exitIfInterrupted())
+inline std::atomic<int>  net_transfers   = 0;
+inline std::atomic<bool> net_interrupted = false;
+// initialized before main() runs, so it's main()'s thread
+inline const std::thread::id main_thread_id = std::this_thread::get_id();
+
+/* Inflates a gzip stream chunk by chunk as it downloads, handing what comes out to a callback.
+ * Data that isn't gzip'd (e.g because curl already decoded its Content-Encoding) is passed through as is.
+ */
+class GzipDecoder
+{
+public:
+    GzipDecoder(std::function<bool(std::string_view)> output) : output(std::move(output)) {}
+    ~GzipDecoder();
+
+    GzipDecoder(const GzipDecoder&)            = delete;
+    GzipDecoder& operator=(const GzipDecoder&) = delete;
+
+    bool write(const std::string_view data);
+    bool finish();
+
+private:
+    std::function<bool(std::string_view)> output;
+    z_stream                              stream{};
+    std::string                           head;
+    bool                                  detected = false, inflating = false, ended = false, failed = false;
+
+    bool consume(const std::string_view data);
+};
+
 bool                     hasEnding(const std::string_view fullString, const std::string_view ending);
 bool                     hasStart(const std::string_view fullString, const std::string_view start);
 std::string              expandVar(std::string str);
 bool                     is_numerical(const std::string_view s, const bool allowSpace = false);
 bool                     taur_read_exec(std::vector<const char*> cmd, std::string& output, const bool exitOnFailure = true);
 void                     interruptHandler(int);
+void                     exitIfInterrupted();
 bool                     taur_exec(std::vector<std::string> cmd, const bool exitOnFailure = true);
 void                     sanitizeStr(std::string& str);
 bool                     is_package_from_syncdb(const char* name, alpm_list_t* syncdbs);
 bool                     commitTransactionAndRelease(const bool soft = false);
 void                     printPkgInfo(const TaurPkg_t& pkg, const std::string_view db_name);
+void                     printPkgInfo(const TaurPkgView_t& pkg, const std::string_view db_name);
 void                     printLocalFullPkgInfo(alpm_pkg_t* pkg);
 std::string              makepkg_list(const std::string_view pkg_name, const std::string_view path);
 void                     getFileValue(u_short& iterIndex, const std::string& line, std::string& str, const size_t& amount);
@@ -124,8 +163,7 @@ bool                          util_db_search(alpm_db_t* db, alpm_list_t* needles
 
 std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>& pkgs, TaurBackend& backend, const bool useGit);
 std::string_view                      binarySearch(const std::vector<std::string>& arr, const std::string_view target);
-std::vector<std::string>              load_aur_list();
-bool                                  update_aur_cache(const bool recursiveCall = false);
+bool                                  update_aur_cache(TaurBackend& backend, const bool recursiveCall = false);
 
 template <typename T>
 struct is_fmt_convertible
@@ -24,6 +24,7 @@
 #include "args.hpp"
 
 #include <alpm.h>
+#include <charconv>
 
 #include "config.hpp"
 #include "util.hpp"
@@ -83,6 +84,15 @@ int parsearg_op(const int opt, const int dryrun)
         case 'r':
                 if(dryrun) break;
                 op.show_recipe = 1; break;
+        case OP_STATS:
+                if(dryrun) break;
+                op.show_stats = 1; break;
+        case OP_AUR_CHANGES:
+                if(dryrun) break;
+                op.show_aur_changes = 1; break;
+        case OP_REFRESH_METADATA:
+                if(dryrun) break;
+                op.refresh_metadata = 1; break;
         default:
                 return 1;
     }
@@ -128,6 +138,14 @@ int parsearg_global(const int opt)
                 config->useGit = true;
                 break;
         
+        case OP_REFRESH_RPC:
+                config->refreshRpc = true;
+                break;
+
+        case OP_OFFLINE:
+                config->offline = true;
+                break;
+        
         case OP_CONFIG:
         case OP_THEME:
                 break;
@@ -186,6 +204,16 @@ int parsearg_sync(const int opt)
             op.op_s_cleanbuild = 1;
             break;
         
+        case OP_LIMIT:
+        {
+            const std::string_view arg = optarg;
+            int limit = 0;
+            if (!is_numerical(arg) || std::from_chars(arg.data(), arg.data() + arg.size(), limit).ec != std::errc())
+                die(_("--limit needs a number of results (0 for no limit), got '{}'"), arg);
+            config->searchLimit = limit;
+            break;
+        }
+        
         default:
             return 1;
     }
@@ -1,10 +1,12 @@
 #define TOML_HEADER_ONLY 0
 #include "config.hpp"
 
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 
 #include "ini.h"
+#include "switch_fnv1a.hpp"
 #include "util.hpp"
 
 Config::~Config()
@@ -86,8 +88,28 @@ void Config::initVars()
     this->debug         = this->getConfigValue<bool>("general.debug", true);
     this->colors        = this->getConfigValue<bool>("general.colors", true);
     this->secretRecipe  = this->getConfigValue<bool>("secret.recipe", false);
+    this->zeroCopySearch = this->getConfigValue<bool>("general.zeroCopySearch", true);
+    this->searchLimit    = std::max(0, this->getConfigValue<int>("general.searchLimit", 0));
+    this->offline        = this->getConfigValue<bool>("general.offline", false);
+    this->indexedSearch  = this->getConfigValue<bool>("general.indexedSearch", false);
     fmt::disable_colors = (!this->colors);
 
+    this->maxConcurrentRequests = std::max(1, this->getConfigValue<int>("network.maxConcurrentRequests", 8));
+    this->maxUrlLength          = std::max(256, this->getConfigValue<int>("network.maxUrlLength", 4096));
+    this->connectTimeout        = std::max(0, this->getConfigValue<int>("network.connectTimeout", 10));
+    this->requestTimeout        = std::max(0, this->getConfigValue<int>("network.timeout", 60));
+    this->maxRetries            = std::max(0, this->getConfigValue<int>("network.retries", 3));
+    this->retryDelay            = std::max(0, this->getConfigValue<int>("network.retryDelay", 500));
+    this->rpcBudget             = std::max(0, this->getConfigValue<int>("network.rpcBudget", 4000));
+    this->prefetchCandidates    = std::max(0, this->getConfigValue<int>("network.prefetchCandidates", 3));
+
+    this->rpcSearchTTL            = std::max(0, this->getConfigValue<int>("cache.searchTTL", 3600));
+    this->rpcInfoTTL              = std::max(0, this->getConfigValue<int>("cache.infoTTL", 900));
+    this->rpcMaxStale             = std::max(0, this->getConfigValue<int>("cache.maxStale", 86400));
+    this->rpcStaleWhileRevalidate = this->getConfigValue<bool>("cache.staleWhileRevalidate", true);
+    this->aurListMaxAge           = std::max(0, this->getConfigValue<int>("cache.aurListMaxAge", 86400));
+    this->metadataMaxAge          = std::max(0, this->getConfigValue<int>("cache.metadataMaxAge", 3600));
+
     sanitizeStr(this->sudo);
     sanitizeStr(this->makepkgBin);
     sanitizeStr(this->makepkgConf);
@@ -99,6 +121,43 @@ void Config::initVars()
         this->editor.push_back(str);
     }
 
+    if (const toml::array* endpoints = this->tbl.at_path("aur.endpoints").as_array())
+    {
+        for (const toml::node& node : *endpoints)
+        {
+            std::string endpoint = expandVar(node.value_or<std::string>(""));
+            sanitizeStr(endpoint);
+            while (hasEnding(endpoint, "/"))
+                endpoint.pop_back();
+
+            if (!endpoint.empty())
+                this->aurEndpoints.push_back(endpoint);
+        }
+    }
+
+    if (this->aurEndpoints.empty())
+        this->aurEndpoints.push_back("https://aur.archlinux.org");
+
+    if (const toml::array* keys = this->tbl.at_path("general.sortBy").as_array())
+    {
+        for (const toml::node& node : *keys)
+        {
+            const std::string key = node.value_or<std::string>("");
+            switch (fnv1a32::hash(key))
+            {
+                case "exact"_fnv1a32:      this->sortBy.push_back(SORT_KEY_EXACT); break;
+                case "prefix"_fnv1a32:     this->sortBy.push_back(SORT_KEY_PREFIX); break;
+                case "popularity"_fnv1a32: this->sortBy.push_back(SORT_KEY_POPULARITY); break;
+                case "votes"_fnv1a32:      this->sortBy.push_back(SORT_KEY_VOTES); break;
+                case "installed"_fnv1a32:  this->sortBy.push_back(SORT_KEY_INSTALLED); break;
+                case "name"_fnv1a32:       this->sortBy.push_back(SORT_KEY_NAME); break;
+                default:                   log_println(WARN, _("Unknown sort key '{}' in general.sortBy, ignoring it"), key);
+            }
+        }
+    }
+    else
+        this->sortBy = { SORT_KEY_EXACT, SORT_KEY_PREFIX, SORT_KEY_POPULARITY, SORT_KEY_VOTES, SORT_KEY_INSTALLED };
+
     const char* no_color = getenv("NO_COLOR");
     if (no_color != NULL && no_color[0] != '\0')
     {
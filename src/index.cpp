@@ -0,0 +1,1092 @@
+#include "index.hpp"
+
+#include <alpm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "config.hpp"
+#include "switch_fnv1a.hpp"
+#include "util.hpp"
+
+// how many names share a bucket of the perfect hash on average, more makes the index smaller but slower to build
+#define AUR_INDEX_BUCKET_SIZE 4
+
+// splitmix64's finalizer, spreads the bits of a hash over the whole word
+static constexpr uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static uint64_t aur_index_hash(const std::string_view name, const uint32_t seed)
+{ return mix64(fnv1a64::hash(name) ^ seed); }
+
+// the upper half picks the bucket, the lower bits are the fingerprint
+static uint32_t aur_index_bucket(const uint64_t hash, const uint32_t buckets)
+{ return (hash >> 32) % buckets; }
+
+static uint16_t aur_index_fingerprint(const uint64_t hash)
+{ return static_cast<uint16_t>(hash); }
+
+// where a name lands with the displacement of its bucket
+static uint32_t aur_index_slot(const uint64_t hash, const uint32_t displacement, const uint32_t count)
+{ return mix64(hash + displacement * 0x9e3779b97f4a7c15ULL) % count; }
+
+// the padding after the blob, so the tables after it are aligned
+static size_t aur_index_padding(const uint64_t blob_size)
+{ return (sizeof(uint32_t) - blob_size % sizeof(uint32_t)) % sizeof(uint32_t); }
+
+MappedFile::MappedFile(const path& file_path)
+{
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    void* mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file alive, even if it gets replaced
+
+    if (mapping == MAP_FAILED)
+        return;
+
+    this->mapping = mapping;
+    this->length  = file_stat.st_size;
+}
+
+MappedFile::~MappedFile()
+{
+    if (this->mapping)
+        munmap(this->mapping, this->length);
+}
+
+AtomicFileWriter::AtomicFileWriter(const path& file_path)
+    : file_path(file_path), tmp_path(file_path.string() + fmt::format(".{}.tmp", getpid()))
+{
+    this->out.open(this->tmp_path, std::ios::binary | std::ios::trunc);
+    if (!this->out.is_open())
+        log_println(ERROR, _("Failed to open/write {}"), this->tmp_path.string());
+}
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+    if (this->committed)
+        return;
+
+    this->out.close();
+    std::error_code err;
+    std::filesystem::remove(this->tmp_path, err);
+}
+
+// @return true if everything was written and the file is in place
+bool AtomicFileWriter::commit()
+{
+    this->out.close();
+    if (this->out.fail())
+    {
+        log_println(ERROR, _("Failed to open/write {}"), this->tmp_path.string());
+        return false;
+    }
+
+    std::error_code err;
+    std::filesystem::rename(this->tmp_path, this->file_path, err);
+    if (err)
+    {
+        log_println(ERROR, _("Failed to rename {} to {}: {}"), this->tmp_path.string(), this->file_path.string(), err.message());
+        return false;
+    }
+
+    this->committed = true;
+    return true;
+}
+
+AurIndex::AurIndex(const path& file_path) : file(file_path)
+{
+    if (this->file.size() < sizeof(aur_index_header_t))
+        return;
+
+    const aur_index_header_t* hdr = reinterpret_cast<const aur_index_header_t*>(this->file.data());
+    const size_t offsets_size     = (static_cast<size_t>(hdr->count) + 1) * sizeof(uint32_t);
+    const size_t tables_size      = static_cast<size_t>(hdr->buckets) * sizeof(uint32_t) +
+                               static_cast<size_t>(hdr->count) * (sizeof(uint32_t) + sizeof(uint16_t));
+
+    if (std::memcmp(hdr->magic, AUR_INDEX_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != AUR_INDEX_VERSION ||
+        (hdr->count > 0 && hdr->buckets == 0) ||
+        sizeof(aur_index_header_t) + offsets_size + hdr->blob_size + aur_index_padding(hdr->blob_size) + tables_size > this->file.size())
+    {
+        log_println(DEBUG, "{} is not a valid index, ignoring it", file_path.string());
+        return;
+    }
+
+    const char*     data = this->file.data() + sizeof(aur_index_header_t);
+    const uint32_t* offs = reinterpret_cast<const uint32_t*>(data);
+    if (offs[hdr->count] != hdr->blob_size)
+        return;
+
+    this->offsets = offs;
+    this->blob    = data + offsets_size;
+
+    data                = this->blob + hdr->blob_size + aur_index_padding(hdr->blob_size);
+    this->displacements = reinterpret_cast<const uint32_t*>(data);
+    this->slots         = this->displacements + hdr->buckets;
+    this->fingerprints  = reinterpret_cast<const uint16_t*>(this->slots + hdr->count);
+    this->header        = hdr;
+}
+
+/** Checks if a package is in the AUR, with the perfect hash.
+ * Every name hashes to its own slot, so only the name in that slot can match,
+ * and its fingerprint rules out most other names without comparing them.
+ * @param name the package name
+ * @return true if the AUR has it
+ */
+bool AurIndex::contains(const std::string_view name) const
+{
+    if (this->size() == 0)
+        return false;
+
+    const uint64_t hash = aur_index_hash(name, this->header->seed);
+    const uint32_t slot = aur_index_slot(hash, this->displacements[aur_index_bucket(hash, this->header->buckets)], this->header->count);
+
+    return this->fingerprints[slot] == aur_index_fingerprint(hash) && this->at(this->slots[slot]) == name;
+}
+
+/** Checks if a package is in the AUR, by binary searching the names in place.
+ * @param name the package name
+ * @return true if the AUR has it
+ */
+bool AurIndex::contains_sorted(const std::string_view name) const
+{
+    size_t left = 0, right = this->size();
+    while (left < right)
+    {
+        const size_t mid = left + (right - left) / 2;
+        const int    cmp = this->at(mid).compare(name);
+        if (cmp == 0)
+            return true;
+        if (cmp < 0)
+            left = mid + 1;
+        else
+            right = mid;
+    }
+
+    return false;
+}
+
+/** Builds a minimal perfect hash (CHD) of the name hashes: the names are put in buckets, and biggest bucket first,
+ * each gets the first displacement that moves all of its names into free slots.
+ * @param hashes the hash of every name
+ * @param buckets how many buckets to use
+ * @param displacements the displacement of each bucket
+ * @param slots the index in hashes of the name in each slot
+ * @return false if a bucket couldn't be placed, then another seed has to be tried
+ */
+static bool build_aur_mph(const std::vector<uint64_t>& hashes, const uint32_t buckets, std::vector<uint32_t>& displacements,
+                          std::vector<uint32_t>& slots)
+{
+    const uint32_t count = hashes.size();
+
+    std::vector<std::vector<uint32_t>> bucket_keys(buckets);
+    for (uint32_t i = 0; i < count; i++)
+        bucket_keys[aur_index_bucket(hashes[i], buckets)].push_back(i);
+
+    std::vector<uint32_t> order(buckets);
+    for (uint32_t i = 0; i < buckets; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(),
+                     [&](const uint32_t a, const uint32_t b) { return bucket_keys[a].size() > bucket_keys[b].size(); });
+
+    std::vector<bool>     taken(count, false);
+    std::vector<uint32_t> positions;
+    displacements.assign(buckets, 0);
+    slots.assign(count, 0);
+
+    for (const uint32_t bucket : order)
+    {
+        const std::vector<uint32_t>& keys = bucket_keys[bucket];
+        if (keys.empty())
+            break;
+
+        // the last buckets only have a few free slots left, so this can take up to ~count tries
+        bool placed = false;
+        for (uint32_t displacement = 0; displacement < (1U << 24) && !placed; displacement++)
+        {
+            positions.clear();
+            for (const uint32_t key : keys)
+            {
+                const uint32_t pos = aur_index_slot(hashes[key], displacement, count);
+                if (taken[pos] || std::find(positions.begin(), positions.end(), pos) != positions.end())
+                    break;
+                positions.push_back(pos);
+            }
+
+            if (positions.size() != keys.size())
+                continue;
+
+            for (size_t i = 0; i < keys.size(); i++)
+            {
+                taken[positions[i]] = true;
+                slots[positions[i]] = keys[i];
+            }
+            displacements[bucket] = displacement;
+            placed                = true;
+        }
+
+        if (!placed)
+            return false;
+    }
+
+    return true;
+}
+
+/** Adds a line of a package list like packages.aur, comments and empty lines are skipped.
+ * @param line the line, without its newline
+ */
+void AurIndexBuilder::add(const std::string_view line)
+{
+    // skip the header comment ("# AUR package list, generated on ...")
+    if (line.empty() || line[0] == '#')
+        return;
+
+    this->blob_size += line.size();
+    this->names.emplace_back(line);
+    this->sorted = false;
+}
+
+void AurIndexBuilder::sort()
+{
+    if (this->sorted)
+        return;
+
+    // packages.aur isn't guaranteed to be sorted
+    std::sort(this->names.begin(), this->names.end());
+    this->names.erase(std::unique(this->names.begin(), this->names.end()), this->names.end());
+    this->sorted = true;
+}
+
+/** Compares the names added so far with an older index, walking both sorted lists side by side.
+ * @param previous the index of the previous package list
+ * @return what was added and removed since previous
+ */
+AurIndexDiff_t AurIndexBuilder::diff(const AurIndex& previous)
+{
+    this->sort();
+
+    AurIndexDiff_t out{ .time = std::time(nullptr) };
+    size_t         i = 0, j = 0;
+    while (i < this->names.size() || j < previous.size())
+    {
+        if (j >= previous.size() || (i < this->names.size() && this->names[i] < previous.at(j)))
+            out.added.push_back(this->names[i++]);
+        else if (i >= this->names.size() || previous.at(j) < this->names[i])
+            out.removed.emplace_back(previous.at(j++));
+        else
+            i++, j++;
+    }
+
+    return out;
+}
+
+/** Writes the names added so far as an index.
+ * @param index_path where to write the index
+ * @return true on success
+ */
+bool AurIndexBuilder::write(const path& index_path)
+{
+    if (this->blob_size > UINT32_MAX)
+    {
+        log_println(ERROR, _("{} would be too big, not indexing the AUR packages"), index_path.string());
+        return false;
+    }
+
+    this->sort();
+    const std::vector<std::string>& names = this->names;
+
+    aur_index_header_t header{};
+    std::memcpy(header.magic, AUR_INDEX_MAGIC, sizeof(header.magic));
+    header.version = AUR_INDEX_VERSION;
+    header.count   = names.size();
+    header.buckets = (names.size() + AUR_INDEX_BUCKET_SIZE - 1) / AUR_INDEX_BUCKET_SIZE;
+
+    std::vector<uint64_t> hashes(names.size());
+    std::vector<uint32_t> displacements, slots;
+    for (bool built = names.empty(); !built; header.seed++)
+    {
+        // a bucket that doesn't fit is very unlikely, and another seed shuffles every bucket
+        if (header.seed == 16)
+        {
+            log_println(ERROR, _("Failed to build the perfect hash of {}"), index_path.string());
+            return false;
+        }
+
+        for (size_t i = 0; i < names.size(); i++)
+            hashes[i] = aur_index_hash(names[i], header.seed);
+
+        if ((built = build_aur_mph(hashes, header.buckets, displacements, slots)))
+            break;
+    }
+
+    std::vector<uint16_t> fingerprints(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        fingerprints[i] = aur_index_fingerprint(hashes[slots[i]]);
+
+    std::vector<uint32_t> offsets;
+    offsets.reserve(names.size() + 1);
+    uint32_t offset = 0;
+    for (const std::string& pkg : names)
+    {
+        offsets.push_back(offset);
+        offset += pkg.size();
+    }
+    offsets.push_back(offset);
+    header.blob_size = offset;
+
+    AtomicFileWriter file(index_path);
+    std::ofstream&   out = file.out;
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    for (const std::string& pkg : names)
+        out.write(pkg.data(), pkg.size());
+
+    const uint32_t padding = 0;
+    out.write(reinterpret_cast<const char*>(&padding), aur_index_padding(header.blob_size));
+    out.write(reinterpret_cast<const char*>(displacements.data()), displacements.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(uint32_t));
+    out.write(reinterpret_cast<const char*>(fingerprints.data()), fingerprints.size() * sizeof(uint16_t));
+
+    if (!file.commit())
+        return false;
+
+    log_println(DEBUG, "indexed {} AUR packages into {}", names.size(), index_path.string());
+    return true;
+}
+
+/** Builds an index out of a package list like packages.aur, one name per line.
+ * @param list_path the package list
+ * @param index_path where to write the index
+ * @return true on success
+ */
+bool build_aur_index(const path& list_path, const path& index_path)
+{
+    std::ifstream list(list_path);
+    if (!list.is_open())
+        return false;
+
+    AurIndexBuilder builder;
+    std::string     line;
+    while (std::getline(list, line))
+        builder.add(line);
+
+    return builder.write(index_path);
+}
+
+// the index of this process, mapped on first use.
+// it's shared, so a refresh doesn't unmap it under someone still looking at the old one
+static std::shared_ptr<const AurIndex> current_index;
+static std::mutex                      current_index_mutex;
+
+// call it after replacing cacheDir/packages.idx, aur_index() maps the new one afterwards
+void reload_aur_index()
+{
+    std::lock_guard<std::mutex> lock(current_index_mutex);
+    current_index.reset();
+}
+
+/** The index of the AUR package names, mapped once per process.
+ * If there is none yet (e.g a cache from an older taur), it's built from packages.aur.
+ * @return the index, empty if there's no packages.aur either
+ */
+std::shared_ptr<const AurIndex> aur_index()
+{
+    std::lock_guard<std::mutex> lock(current_index_mutex);
+    if (current_index)
+        return current_index;
+
+    const path& list_path  = config->cacheDir / "packages.aur";
+    const path& index_path = config->cacheDir / "packages.idx";
+
+    current_index = std::make_shared<const AurIndex>(index_path);
+    if (!current_index->valid() && build_aur_index(list_path, index_path))
+        current_index = std::make_shared<const AurIndex>(index_path);
+
+    return current_index;
+}
+
+/* cacheDir/packages.changes, what the last refresh of packages.aur changed:
+ *   # <unix time of the refresh>
+ *   +<added package>
+ *   -<removed package>
+ */
+
+/** Writes what a refresh of the package list changed, replacing the previous changes.
+ * @param diff the changes
+ * @param changes_path where to write them
+ * @return true on success
+ */
+bool write_aur_changes(const AurIndexDiff_t& diff, const path& changes_path)
+{
+    AtomicFileWriter file(changes_path);
+    file.out << "# " << diff.time << '\n';
+    for (const std::string& name : diff.added)
+        file.out << '+' << name << '\n';
+    for (const std::string& name : diff.removed)
+        file.out << '-' << name << '\n';
+
+    return file.commit();
+}
+
+/** Reads what the last refresh of the package list changed.
+ * @param changes_path the file written by write_aur_changes()
+ * @return the changes, or an empty optional if none were recorded yet
+ */
+std::optional<AurIndexDiff_t> read_aur_changes(const path& changes_path)
+{
+    std::ifstream in(changes_path);
+    if (!in.is_open())
+        return {};
+
+    AurIndexDiff_t diff;
+    std::string    line;
+    while (std::getline(in, line))
+    {
+        if (line.size() < 2)
+            continue;
+
+        switch (line[0])
+        {
+            case '#': diff.time = std::strtoll(line.c_str() + 2, nullptr, 10); break;
+            case '+': diff.added.push_back(line.substr(1)); break;
+            case '-': diff.removed.push_back(line.substr(1)); break;
+        }
+    }
+
+    return diff;
+}
+
+// splits a dependency like "foo>=1.0" into its name, comparison operator and version
+static void split_depend(const std::string_view depend, std::string_view& name, std::string_view& op, std::string_view& version)
+{
+    const size_t op_pos = depend.find_first_of("<>=");
+    name                = depend.substr(0, op_pos);
+    op = version = {};
+    if (op_pos == depend.npos)
+        return;
+
+    const size_t version_pos = depend.find_first_not_of("<>=", op_pos);
+    op                       = depend.substr(op_pos, version_pos - op_pos);
+    version                  = version_pos == depend.npos ? std::string_view() : depend.substr(version_pos);
+}
+
+// whether a provide of the given version satisfies the version constraint of a dependency, like pacman does
+static bool provide_satisfies(const std::string_view provide_version, const std::string_view op, const std::string_view version)
+{
+    if (op.empty())
+        return true;
+
+    // an unversioned provide doesn't satisfy a versioned dependency
+    if (provide_version.empty())
+        return false;
+
+    const int cmp = alpm_pkg_vercmp(std::string(provide_version).c_str(), std::string(version).c_str());
+    switch (fnv1a16::hash(op))
+    {
+        case "="_fnv1a16:  return cmp == 0;
+        case ">="_fnv1a16: return cmp >= 0;
+        case "<="_fnv1a16: return cmp <= 0;
+        case ">"_fnv1a16:  return cmp > 0;
+        case "<"_fnv1a16:  return cmp < 0;
+        default:           return false;
+    }
+}
+
+AurProvidesIndex::AurProvidesIndex(const path& file_path) : file(file_path)
+{
+    if (this->file.size() < sizeof(aur_provides_header_t))
+        return;
+
+    const aur_provides_header_t* hdr = reinterpret_cast<const aur_provides_header_t*>(this->file.data());
+    if (std::memcmp(hdr->magic, AUR_PROVIDES_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != AUR_PROVIDES_VERSION ||
+        sizeof(aur_provides_header_t) + static_cast<size_t>(hdr->count) * sizeof(aur_provides_entry_t) + hdr->blob_size > this->file.size())
+    {
+        log_println(DEBUG, "{} is not a valid index, ignoring it", file_path.string());
+        return;
+    }
+
+    this->entries = reinterpret_cast<const aur_provides_entry_t*>(this->file.data() + sizeof(aur_provides_header_t));
+    this->blob    = reinterpret_cast<const char*>(this->entries + hdr->count);
+    this->header  = hdr;
+}
+
+/** Finds the AUR packages that can satisfy a dependency through what they provide.
+ * @param depend the dependency, optionally with a version constraint (e.g "java-runtime>=17")
+ * @return the names of the providers, sorted
+ */
+std::vector<std::string_view> AurProvidesIndex::providers(const std::string_view depend) const
+{
+    std::string_view name, op, version;
+    split_depend(depend, name, op, version);
+
+    const aur_provides_entry_t* end   = this->entries + this->size();
+    const aur_provides_entry_t* first = std::lower_bound(this->entries, end, name, [this](const aur_provides_entry_t& entry, const std::string_view value) {
+        return this->str(entry.name, entry.name_len) < value;
+    });
+
+    std::vector<std::string_view> out;
+    for (const aur_provides_entry_t* entry = first; entry != end && this->str(entry->name, entry->name_len) == name; entry++)
+    {
+        if (provide_satisfies(this->str(entry->version, entry->version_len), op, version))
+            out.push_back(this->str(entry->pkg, entry->pkg_len));
+    }
+
+    return out;
+}
+
+/** Adds something a package provides.
+ * @param pkg the package name
+ * @param provide what it provides, optionally with a version (e.g "libfoo.so=1-64")
+ */
+void AurProvidesBuilder::add(const std::string_view pkg, const std::string_view provide)
+{
+    const size_t     eq      = provide.find('=');
+    const std::string_view name    = provide.substr(0, eq);
+    const std::string_view version = eq == provide.npos ? std::string_view() : provide.substr(eq + 1);
+
+    // a package providing itself doesn't tell us anything packages.idx doesn't
+    if (name.empty() || name == pkg)
+        return;
+
+    this->blob_size += name.size() + pkg.size() + version.size();
+    this->provides.push_back({ std::string(name), std::string(pkg), std::string(version) });
+}
+
+/** Writes what was added so far as an index.
+ * @param index_path where to write the index
+ * @return true on success
+ */
+bool AurProvidesBuilder::write(const path& index_path)
+{
+    if (this->blob_size > UINT32_MAX)
+    {
+        log_println(ERROR, _("{} would be too big, not indexing the AUR provides"), index_path.string());
+        return false;
+    }
+
+    std::sort(this->provides.begin(), this->provides.end(), [](const provide_t& a, const provide_t& b) {
+        return std::tie(a.name, a.pkg, a.version) < std::tie(b.name, b.pkg, b.version);
+    });
+
+    aur_provides_header_t header{};
+    std::memcpy(header.magic, AUR_PROVIDES_MAGIC, sizeof(header.magic));
+    header.version   = AUR_PROVIDES_VERSION;
+    header.count     = this->provides.size();
+    header.blob_size = this->blob_size;
+
+    std::vector<aur_provides_entry_t> entries;
+    entries.reserve(this->provides.size());
+    uint32_t offset = 0;
+    for (const provide_t& provide : this->provides)
+    {
+        aur_provides_entry_t& entry = entries.emplace_back();
+        entry.name = offset, entry.name_len = provide.name.size();
+        offset += provide.name.size();
+        entry.pkg = offset, entry.pkg_len = provide.pkg.size();
+        offset += provide.pkg.size();
+        entry.version = offset, entry.version_len = provide.version.size();
+        offset += provide.version.size();
+    }
+
+    AtomicFileWriter file(index_path);
+    file.out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(aur_provides_entry_t));
+    for (const provide_t& provide : this->provides)
+    {
+        file.out.write(provide.name.data(), provide.name.size());
+        file.out.write(provide.pkg.data(), provide.pkg.size());
+        file.out.write(provide.version.data(), provide.version.size());
+    }
+
+    if (!file.commit())
+        return false;
+
+    log_println(DEBUG, "indexed {} AUR provides into {}", this->provides.size(), index_path.string());
+    return true;
+}
+
+static std::shared_ptr<const AurProvidesIndex> current_provides_index;
+static std::mutex                              current_provides_index_mutex;
+
+// call it after replacing cacheDir/provides.idx, aur_provides_index() maps the new one afterwards
+void reload_aur_provides_index()
+{
+    std::lock_guard<std::mutex> lock(current_provides_index_mutex);
+    current_provides_index.reset();
+}
+
+/** What the AUR packages provide, mapped once per process.
+ * It's built by "taur --refresh-metadata", so it's empty until then.
+ */
+std::shared_ptr<const AurProvidesIndex> aur_provides_index()
+{
+    std::lock_guard<std::mutex> lock(current_provides_index_mutex);
+    if (!current_provides_index)
+        current_provides_index = std::make_shared<const AurProvidesIndex>(config->cacheDir / "provides.idx");
+
+    return current_provides_index;
+}
+
+AurMetaStore::AurMetaStore(const path& file_path) : file(file_path)
+{
+    if (this->file.size() < sizeof(aur_meta_header_t))
+        return;
+
+    const aur_meta_header_t* hdr = reinterpret_cast<const aur_meta_header_t*>(this->file.data());
+    if (std::memcmp(hdr->magic, AUR_META_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != AUR_META_VERSION)
+    {
+        log_println(DEBUG, "{} is not a valid store, ignoring it", file_path.string());
+        return;
+    }
+
+    const size_t count = hdr->count;
+    const size_t size  = sizeof(aur_meta_header_t) + count * 2 * sizeof(int64_t) + count * 6 * sizeof(uint32_t) + count * 2 * sizeof(float) +
+                        (count + 1) * 3 * sizeof(uint32_t) +
+                        (static_cast<size_t>(hdr->licenses_count) + hdr->depends_count + hdr->makedepends_count) * sizeof(uint32_t) +
+                        hdr->strings_size;
+    // the string table ends with a null, so a corrupted offset can't read past it
+    if (size > this->file.size() || hdr->strings_size == 0 || this->file.data()[size - 1] != '\0')
+    {
+        log_println(DEBUG, "{} is truncated, ignoring it", file_path.string());
+        return;
+    }
+
+    const char* p           = this->file.data() + sizeof(aur_meta_header_t);
+    const auto  next_column = [&p]<typename T>(const T*& column, const size_t n) {
+        column = reinterpret_cast<const T*>(p);
+        p += n * sizeof(T);
+    };
+
+    next_column(this->last_modified_col, count);
+    next_column(this->outofdate_col, count);
+    next_column(this->name_col, count);
+    next_column(this->version_col, count);
+    next_column(this->desc_col, count);
+    next_column(this->url_col, count);
+    next_column(this->url_path_col, count);
+    next_column(this->maintainer_col, count);
+    next_column(this->popularity_col, count);
+    next_column(this->votes_col, count);
+    next_column(this->licenses_index, count + 1);
+    next_column(this->licenses_list, hdr->licenses_count);
+    next_column(this->depends_index, count + 1);
+    next_column(this->depends_list, hdr->depends_count);
+    next_column(this->makedepends_index, count + 1);
+    next_column(this->makedepends_list, hdr->makedepends_count);
+    this->strings = p;
+    this->header  = hdr;
+}
+
+std::optional<size_t> AurMetaStore::find(const std::string_view name) const
+{
+    const uint32_t* end   = this->name_col + this->size();
+    const uint32_t* found = std::lower_bound(this->name_col, end, name,
+                                             [this](const uint32_t ref, const std::string_view value) { return this->strings + ref < value; });
+
+    if (found == end || this->strings + *found != name)
+        return {};
+
+    return found - this->name_col;
+}
+
+// the offset of str in the string table, adding it if it's not there yet
+uint32_t AurMetaBuilder::intern(const std::string& str)
+{
+    if (str.empty())
+        return 0;
+
+    const auto& [it, inserted] = this->string_offsets.try_emplace(str, this->strings.size());
+    if (inserted)
+        this->strings.append(str.c_str(), str.size() + 1);
+
+    return it->second;
+}
+
+void AurMetaBuilder::add(const AurMetaPkg_t& pkg)
+{
+    const auto add_list = [this](std::vector<uint32_t>& list, const std::vector<std::string>& values) {
+        const size_t begin = list.size();
+        for (const std::string& value : values)
+            list.push_back(this->intern(value));
+        return std::make_pair(begin, list.size());
+    };
+
+    this->rows.push_back({ .name          = this->intern(pkg.name),
+                           .version       = this->intern(pkg.version),
+                           .desc          = this->intern(pkg.desc),
+                           .url           = this->intern(pkg.url),
+                           .url_path      = this->intern(pkg.url_path),
+                           .maintainer    = this->intern(pkg.maintainer),
+                           .last_modified = pkg.last_modified,
+                           .outofdate     = pkg.outofdate,
+                           .popularity    = pkg.popularity,
+                           .votes         = pkg.votes,
+                           .licenses      = add_list(this->licenses, pkg.licenses),
+                           .depends       = add_list(this->depends, pkg.depends),
+                           .makedepends   = add_list(this->makedepends, pkg.makedepends) });
+}
+
+/** Writes the packages added so far as a store, sorted by name.
+ * @param store_path where to write the store
+ * @param snapshot when the packages were downloaded
+ * @return true on success
+ */
+bool AurMetaBuilder::write(const path& store_path, const std::time_t snapshot)
+{
+    if (this->strings.size() > UINT32_MAX || this->depends.size() > UINT32_MAX || this->makedepends.size() > UINT32_MAX ||
+        this->licenses.size() > UINT32_MAX)
+    {
+        log_println(ERROR, _("{} would be too big, not storing the AUR metadata"), store_path.string());
+        return false;
+    }
+
+    std::sort(this->rows.begin(), this->rows.end(), [this](const row_t& a, const row_t& b) {
+        return std::string_view(this->strings.data() + a.name) < std::string_view(this->strings.data() + b.name);
+    });
+
+    aur_meta_header_t header{};
+    std::memcpy(header.magic, AUR_META_MAGIC, sizeof(header.magic));
+    header.version           = AUR_META_VERSION;
+    header.count             = this->rows.size();
+    header.licenses_count    = this->licenses.size();
+    header.depends_count     = this->depends.size();
+    header.makedepends_count = this->makedepends.size();
+    header.snapshot          = snapshot;
+    header.strings_size      = this->strings.size();
+
+    AtomicFileWriter file(store_path);
+    file.out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    // get returns the value of the column, as the type it's stored as
+    const auto write_column = [&](const auto& get) {
+        for (const row_t& row : this->rows)
+        {
+            const auto value = get(row);
+            file.out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        }
+    };
+
+    // CSR: the index of every row, then the lists in row order
+    const auto write_lists = [&](const std::vector<uint32_t>& list, std::pair<size_t, size_t> row_t::*range) {
+        uint32_t index = 0;
+        file.out.write(reinterpret_cast<const char*>(&index), sizeof(index));
+        for (const row_t& row : this->rows)
+        {
+            index += (row.*range).second - (row.*range).first;
+            file.out.write(reinterpret_cast<const char*>(&index), sizeof(index));
+        }
+        for (const row_t& row : this->rows)
+            file.out.write(reinterpret_cast<const char*>(list.data() + (row.*range).first),
+                           ((row.*range).second - (row.*range).first) * sizeof(uint32_t));
+    };
+
+    write_column([](const row_t& row) -> int64_t { return row.last_modified; });
+    write_column([](const row_t& row) -> int64_t { return row.outofdate; });
+    write_column([](const row_t& row) -> uint32_t { return row.name; });
+    write_column([](const row_t& row) -> uint32_t { return row.version; });
+    write_column([](const row_t& row) -> uint32_t { return row.desc; });
+    write_column([](const row_t& row) -> uint32_t { return row.url; });
+    write_column([](const row_t& row) -> uint32_t { return row.url_path; });
+    write_column([](const row_t& row) -> uint32_t { return row.maintainer; });
+    write_column([](const row_t& row) -> float { return row.popularity; });
+    write_column([](const row_t& row) -> float { return row.votes; });
+    write_lists(this->licenses, &row_t::licenses);
+    write_lists(this->depends, &row_t::depends);
+    write_lists(this->makedepends, &row_t::makedepends);
+    file.out.write(this->strings.data(), this->strings.size());
+
+    if (!file.commit())
+        return false;
+
+    log_println(DEBUG, "stored the metadata of {} AUR packages into {} ({} distinct strings)", this->rows.size(), store_path.string(),
+                this->string_offsets.size());
+    return true;
+}
+
+static std::shared_ptr<const AurMetaStore> current_meta_store;
+static std::mutex                          current_meta_store_mutex;
+
+// call it after replacing cacheDir/packages-meta.idx, aur_meta_store() maps the new one afterwards
+void reload_aur_meta_store()
+{
+    std::lock_guard<std::mutex> lock(current_meta_store_mutex);
+    current_meta_store.reset();
+}
+
+/** The AUR metadata store, mapped once per process.
+ * It's built by "taur --refresh-metadata", so it's empty until then.
+ */
+std::shared_ptr<const AurMetaStore> aur_meta_store()
+{
+    std::lock_guard<std::mutex> lock(current_meta_store_mutex);
+    if (!current_meta_store)
+        current_meta_store = std::make_shared<const AurMetaStore>(config->cacheDir / "packages-meta.idx");
+
+    return current_meta_store;
+}
+
+// the trigram of the 3 bytes at text, lowercased like the AUR search ignores case (only ASCII)
+static uint32_t trigram_at(const char* text)
+{
+    const auto lower = [](const unsigned char c) -> uint32_t { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; };
+    return lower(text[0]) << 16 | lower(text[1]) << 8 | lower(text[2]);
+}
+
+// reads a posting list back, one document at a time
+class PostingReader
+{
+public:
+    PostingReader(const uint8_t* begin, const uint8_t* end) : p(begin), end(end) {}
+
+    bool next(uint32_t& doc)
+    {
+        if (p == end)
+            return false;
+
+        uint32_t delta = 0;
+        for (int shift = 0; p != end; shift += 7)
+        {
+            const uint8_t byte = *p++;
+            delta |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+
+        doc = last += delta;
+        return true;
+    }
+
+private:
+    const uint8_t *p, *end;
+    uint32_t       last = 0;
+};
+
+TrigramIndex::TrigramIndex(const path& file_path) : file(file_path)
+{
+    if (this->file.size() < sizeof(trigram_index_header_t))
+        return;
+
+    const trigram_index_header_t* hdr = reinterpret_cast<const trigram_index_header_t*>(this->file.data());
+    if (std::memcmp(hdr->magic, TRIGRAM_INDEX_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != TRIGRAM_INDEX_VERSION)
+    {
+        log_println(DEBUG, "{} is not a valid index, ignoring it", file_path.string());
+        return;
+    }
+
+    const bool   has_keys = hdr->doc_keys_size > 0;
+    const size_t size     = sizeof(trigram_index_header_t) + (hdr->trigrams + 1) * sizeof(uint64_t) + hdr->trigrams * 2 * sizeof(uint32_t) +
+                        (has_keys ? (hdr->docs + 1) * sizeof(uint32_t) : 0) + hdr->postings_size + hdr->doc_keys_size;
+    if (size > this->file.size())
+    {
+        log_println(DEBUG, "{} is truncated, ignoring it", file_path.string());
+        return;
+    }
+
+    this->offsets     = reinterpret_cast<const uint64_t*>(this->file.data() + sizeof(trigram_index_header_t));
+    this->keys        = reinterpret_cast<const uint32_t*>(this->offsets + hdr->trigrams + 1);
+    this->counts      = this->keys + hdr->trigrams;
+    this->doc_offsets = has_keys ? this->counts + hdr->trigrams : nullptr;
+    this->postings    = reinterpret_cast<const uint8_t*>(this->counts + hdr->trigrams + (has_keys ? hdr->docs + 1 : 0));
+    this->doc_keys    = reinterpret_cast<const char*>(this->postings + hdr->postings_size);
+    this->header      = hdr;
+}
+
+/** Finds the documents that can contain query, by intersecting the lists of its trigrams, the shortest first.
+ * The lists are decoded while they're intersected, only the shortest one is ever decoded whole.
+ * @param query what to search, case doesn't matter
+ * @return the documents that have every trigram of query, or nothing if query is shorter than a trigram
+ */
+std::optional<std::vector<uint32_t>> TrigramIndex::candidates(const std::string_view query) const
+{
+    if (query.size() < 3)
+        return {};
+
+    std::vector<uint32_t> trigrams;
+    for (size_t i = 0; i + 3 <= query.size(); i++)
+        trigrams.push_back(trigram_at(query.data() + i));
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    // the position of each trigram in keys
+    std::vector<size_t> lists;
+    lists.reserve(trigrams.size());
+    const uint32_t* keys_end = this->keys + this->header->trigrams;
+    for (const uint32_t trigram : trigrams)
+    {
+        const uint32_t* found = std::lower_bound(this->keys, keys_end, trigram);
+        if (found == keys_end || *found != trigram)
+            return std::vector<uint32_t>();  // no document has it
+
+        lists.push_back(found - this->keys);
+    }
+
+    std::sort(lists.begin(), lists.end(), [this](const size_t a, const size_t b) { return this->counts[a] < this->counts[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve(this->counts[lists.front()]);
+    PostingReader first(this->postings + this->offsets[lists.front()], this->postings + this->offsets[lists.front() + 1]);
+    for (uint32_t doc; first.next(doc);)
+        out.push_back(doc);
+
+    for (size_t l = 1; l < lists.size() && !out.empty(); l++)
+    {
+        PostingReader reader(this->postings + this->offsets[lists[l]], this->postings + this->offsets[lists[l] + 1]);
+        size_t        kept = 0;
+        uint32_t      doc  = 0;
+        bool          more = reader.next(doc);
+        for (const uint32_t candidate : out)
+        {
+            while (more && doc < candidate)
+                more = reader.next(doc);
+            if (!more)
+                break;
+            if (doc == candidate)
+                out[kept++] = candidate;
+        }
+        out.resize(kept);
+    }
+
+    return out;
+}
+
+/** Adds the next document.
+ * @param key what the document stands for, e.g a package name, it's given back by TrigramIndex::doc_key()
+ * @param texts what can be searched, trigrams don't span two texts
+ */
+void TrigramIndexBuilder::add(const std::string_view key, std::span<const std::string_view> texts)
+{
+    const uint32_t doc = this->doc_offsets.size() - 1;
+
+    this->doc_trigrams.clear();
+    for (const std::string_view text : texts)
+        for (size_t i = 0; i + 3 <= text.size(); i++)
+            this->doc_trigrams.push_back(trigram_at(text.data() + i));
+    std::sort(this->doc_trigrams.begin(), this->doc_trigrams.end());
+    this->doc_trigrams.erase(std::unique(this->doc_trigrams.begin(), this->doc_trigrams.end()), this->doc_trigrams.end());
+
+    // documents are added in order, so the lists stay sorted
+    for (const uint32_t trigram : this->doc_trigrams)
+        this->lists[trigram].push_back(doc);
+
+    this->doc_keys.append(key);
+    this->doc_offsets.push_back(this->doc_keys.size());
+}
+
+/** Writes the documents added so far as an index.
+ * @param index_path where to write the index
+ * @param stamp what the documents were read from, see trigram_index_header_t
+ * @return true on success
+ */
+bool TrigramIndexBuilder::write(const path& index_path, const uint64_t stamp)
+{
+    if (this->doc_keys.size() > UINT32_MAX)
+    {
+        log_println(ERROR, _("{} would be too big, not indexing it"), index_path.string());
+        return false;
+    }
+
+    std::vector<uint32_t> keys;
+    keys.reserve(this->lists.size());
+    for (const auto& [trigram, list] : this->lists)
+        keys.push_back(trigram);
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint64_t> offsets;
+    std::vector<uint32_t> counts;
+    std::vector<uint8_t>  postings;
+    offsets.reserve(keys.size() + 1);
+    counts.reserve(keys.size());
+    for (const uint32_t trigram : keys)
+    {
+        const std::vector<uint32_t>& list = this->lists[trigram];
+        offsets.push_back(postings.size());
+        counts.push_back(list.size());
+
+        uint32_t last = 0;
+        for (const uint32_t doc : list)
+        {
+            for (uint32_t delta = doc - last; ; delta >>= 7)
+            {
+                if (delta < 0x80)
+                {
+                    postings.push_back(delta);
+                    break;
+                }
+                postings.push_back((delta & 0x7f) | 0x80);
+            }
+            last = doc;
+        }
+    }
+    offsets.push_back(postings.size());
+
+    trigram_index_header_t header{};
+    std::memcpy(header.magic, TRIGRAM_INDEX_MAGIC, sizeof(header.magic));
+    header.version       = TRIGRAM_INDEX_VERSION;
+    header.trigrams      = keys.size();
+    header.docs          = this->doc_offsets.size() - 1;
+    header.stamp         = stamp;
+    header.postings_size = postings.size();
+    header.doc_keys_size = this->doc_keys.size();
+
+    AtomicFileWriter file(index_path);
+    file.out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint64_t));
+    file.out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint32_t));
+    file.out.write(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(uint32_t));
+    if (!this->doc_keys.empty())
+        file.out.write(reinterpret_cast<const char*>(this->doc_offsets.data()), this->doc_offsets.size() * sizeof(uint32_t));
+    file.out.write(reinterpret_cast<const char*>(postings.data()), postings.size());
+    file.out.write(this->doc_keys.data(), this->doc_keys.size());
+
+    if (!file.commit())
+        return false;
+
+    log_println(DEBUG, "indexed {} trigrams of {} documents into {} ({} bytes of postings)", keys.size(), header.docs,
+                index_path.string(), postings.size());
+    return true;
+}
+
+static std::unordered_map<std::string, std::shared_ptr<const TrigramIndex>> current_search_indexes;
+static std::mutex                                                           current_search_indexes_mutex;
+
+// call it after replacing cacheDir/<name>, search_index() maps the new one afterwards
+void reload_search_index(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(current_search_indexes_mutex);
+    current_search_indexes.erase(name);
+}
+
+std::shared_ptr<const TrigramIndex> search_index(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(current_search_indexes_mutex);
+    std::shared_ptr<const TrigramIndex>& index = current_search_indexes[name];
+    if (!index)
+        index = std::make_shared<const TrigramIndex>(config->cacheDir / name);
+
+    return index;
+}
@@ -25,6 +25,7 @@
 #include <limits.h>
 
 #include "args.hpp"
+#include "index.hpp"
 #include "taur.hpp"
 #include "util.hpp"
 
@@ -59,6 +60,7 @@ void usage(const int op)
             fmt::println("usage:  taur {{-S --sync}} [options] [package(s)]");
             fmt::println("options:{}", R"(
     -s, --search <regex> search remote repositories for matching strings
+    --limit     <n>      show only the n best ranked search results
     -u, --sysupgrade     upgrade installed packages (-uu enables downgrades)
     -y, --refresh        download fresh package databases from the server
             )"sv);
@@ -82,6 +84,11 @@ void usage(const int op)
     --debug     <1,0>    show debug messages
     --sudo      <path>   choose which binary to use for privilege-escalation
     --noconfirm          do not ask for any confirmation (passed to both makepkg and pacman)
+    --refresh-rpc        ignore cached AUR responses and query the AUR again
+    --offline            never use the network, answer from the stored AUR metadata and cloned repos
+    --stats              show how many AUR requests are left for today
+    --aur-changes        show which packages appeared in or disappeared from the AUR on the last refresh
+    --refresh-metadata   download the AUR metadata, so lookups and provides are answered locally
     )"sv);
 }
 
@@ -186,26 +193,59 @@ int installPkg(alpm_list_t* pkgNames)
 
     if (op.op_s_search)
     {
-        for (size_t i = 0; i < pkgNamesVec.size(); i++)
+        // every term is searched at once, the AUR requests and the sync DB searches all overlap.
+        // the results are still printed in the order of the terms, each one as soon as it's ready
+        std::vector<std::future<SearchResults_t>> searches;
+        searches.reserve(pkgNamesVec.size());
+
+        for (const std::string_view query : pkgNamesVec)
+        {
+            searches.push_back(std::async(std::launch::async, [query, useGit]() {
+                if (config->zeroCopySearch)
+                    return backend->search_ranked(query, config->aurOnly);
+
+                // the same results, copied out of the views
+                SearchResults_t results{ .repos = backend->search(query, useGit, config->aurOnly, false) };
+                for (size_t i = 0; i < results.repos.size(); i++)
+                    results.ranked.emplace_back(false, i);
+                return results;
+            }));
+        }
+
+        for (size_t i = 0; i < searches.size(); i++)
         {
-            const std::vector<TaurPkg_t>& pkgs = backend->search(pkgNamesVec[i], useGit, config->aurOnly, false);
+            const SearchResults_t& results = searches[i].get();
+
+            // let the other searches finish cancelling before exiting from under them
+            if (net_interrupted)
+            {
+                for (const std::future<SearchResults_t>& search : searches)
+                    if (search.valid())
+                        search.wait();
+                exitIfInterrupted();
+            }
 
-            if (pkgs.empty())
+            if (results.ranked.empty())
             {
                 log_println(WARN, _("No results found for {}!"), pkgNamesVec[i]);
                 returnStatus = false;
                 continue;
             }
 
-            for (size_t i = 0; i < pkgs.size(); i++)
-                printPkgInfo(pkgs[i], pkgs[i].db_name);
+            for (const auto& [aur, j] : results.ranked)
+            {
+                if (aur)
+                    printPkgInfo(results.aur.pkgs[j], "aur");
+                else
+                    printPkgInfo(results.repos[j], results.repos[j].db_name);
+            }
 
             returnStatus = true;
         }
         return returnStatus;
     }
 
-    if (!update_aur_cache())
+    if (!update_aur_cache(*backend))
         log_println(ERROR, _("Failed to get information about {}"), (config->cacheDir / "packages.aur").string());
 
     // I swear there was a comment here..
@@ -227,8 +267,8 @@ int installPkg(alpm_list_t* pkgNames)
     {
         const path& pkgDir = cacheDir / pkg_name;
 
-        stat = useGit ? backend->download_git(AUR_URL_GIT(pkg_name), pkgDir)
-                      : backend->download_tar(AUR_URL_TAR(pkg_name), pkgDir);
+        stat = useGit ? backend->download_git(AUR_URL_GIT(backend->aur_url(), pkg_name), pkgDir)
+                      : backend->download_tar(AUR_URL_TAR(backend->aur_url(), pkg_name), pkgDir);
         if (!stat)
         {
             log_println(ERROR, _("Failed to download {}"), pkg_name);
@@ -288,6 +328,9 @@ int installPkg(alpm_list_t* pkgNames)
             op_s += 'u';
 
         pacman_exec(op_s, pacmanPkgs);
+
+        if (op.op_s_sync && config->indexedSearch)
+            backend->update_repos_search_index();
     }
 
     if (op.op_s_upgrade)
@@ -675,12 +718,16 @@ int parseargs(int argc, char* argv[])
         {"help",       no_argument,       0, 'h'},
         {"test-colors",no_argument,       0, 't'},
         {"recipe",     no_argument,       0, 'r'},
+        {"stats",      no_argument,       0, OP_STATS},
+        {"aur-changes",no_argument,       0, OP_AUR_CHANGES},
+        {"refresh-metadata", no_argument, 0, OP_REFRESH_METADATA},
 
         {"refresh",    no_argument,       0, OP_REFRESH},
         {"sysupgrade", no_argument,       0, OP_SYSUPGRADE},
         {"search",     no_argument,       0, OP_SEARCH},
         {"info",       no_argument,       0, OP_INFO},
         {"cleanbuild", no_argument,       0, OP_CLEANBUILD},
+        {"limit",      required_argument, 0, OP_LIMIT},
         {"cachedir",   required_argument, 0, OP_CACHEDIR},
         {"colors",     required_argument, 0, OP_COLORS},
         {"config",     required_argument, 0, OP_CONFIG},
@@ -693,6 +740,8 @@ int parseargs(int argc, char* argv[])
         {"noconfirm",  no_argument,       0, OP_NOCONFIRM},
         {"nosave",     no_argument,       0, OP_NOSAVE},
         {"recursive",  no_argument,       0, OP_RECURSIVE},
+        {"refresh-rpc",no_argument,       0, OP_REFRESH_RPC},
+        {"offline",    no_argument,       0, OP_OFFLINE},
         {0,0,0,0}
     };
 
@@ -832,6 +881,41 @@ int main(int argc, char* argv[])
     // the code you're likely interested in
     backend = std::make_unique<TaurBackend>(*config);
 
+    if (op.show_stats)
+    {
+        const size_t used = backend->rpc_budget_used();
+        fmt::println(fmt::runtime(_("AUR requests sent in the last 24 hours: {}")), used);
+        if (config->rpcBudget > 0)
+            fmt::println(fmt::runtime(_("Remaining budget: {} of {}")), used >= static_cast<size_t>(config->rpcBudget) ? 0 : config->rpcBudget - used,
+                         config->rpcBudget);
+        return 0;
+    }
+
+    if (op.show_aur_changes)
+    {
+        const std::optional<AurIndexDiff_t>& changes = read_aur_changes(config->cacheDir / "packages.changes");
+        if (!changes)
+        {
+            log_println(INFO, _("No changes recorded yet, they are recorded when the AUR package list gets refreshed"));
+            return 0;
+        }
+
+        std::string timestr = std::ctime(&changes->time);
+        timestr.pop_back();
+        fmt::println(fmt::runtime(_("AUR package list refreshed on {}: {} added, {} removed")), timestr, changes->added.size(),
+                     changes->removed.size());
+
+        for (const std::string& name : changes->added)
+            fmt::println("{} {}", fmt::format(BOLD_COLOR(color.green), "+"), name);
+        for (const std::string& name : changes->removed)
+            fmt::println("{} {}", fmt::format(BOLD_COLOR(color.red), "-"), name);
+
+        return 0;
+    }
+
+    if (op.refresh_metadata)
+        return backend->update_aur_metadata() ? 0 : 1;
+
     if (op.requires_root && geteuid() != 0)
     {
         log_println(ERROR, _("You need to be root to do this."));
@@ -2,17 +2,1658 @@
 // main.cpp simply pieces each function together to make the program work.
 #include "taur.hpp"
 
+#include <rapidjson/istreamwrapper.h>
+#include <rapidjson/reader.h>
+#include <rapidjson/stream.h>
+#include <signal.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <iterator>
+#include <limits>
+#include <sstream>
+#include <random>
+#include <thread>
+
+#include "config.hpp"
+#include "index.hpp"
+#include "switch_fnv1a.hpp"
+#include "util.hpp"
+
+static void curl_share_lock(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+{ reinterpret_cast<std::mutex*>(userptr)[data].lock(); }
+
+static void curl_share_unlock(CURL*, curl_lock_data data, void* userptr)
+{ reinterpret_cast<std::mutex*>(userptr)[data].unlock(); }
+
+TaurBackend::TaurBackend(Config& cfg) : config(cfg), endpoints(cfg.aurEndpoints)
+{
+    this->curl_share = curl_share_init();
+    curl_share_setopt(this->curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(this->curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(this->curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(this->curl_share, CURLSHOPT_LOCKFUNC, curl_share_lock);
+    curl_share_setopt(this->curl_share, CURLSHOPT_UNLOCKFUNC, curl_share_unlock);
+    curl_share_setopt(this->curl_share, CURLSHOPT_USERDATA, this->curl_share_locks);
+}
+
+TaurBackend::~TaurBackend()
+{
+    for (std::future<void>& refresh : this->rpc_refreshes)
+        refresh.wait();
+
+    if (this->lookups_saved > 0)
+        log_println(DEBUG, "AUR lookups: {} packages, {} lookups answered from earlier in this run",
+                    this->pkg_lookups.size(), this->lookups_saved.load());
+
+    if (this->net_requests > 0)
+        log_println(DEBUG, "HTTP requests: {} ({} reused a pooled connection, {} retries, {}ms spent waiting to retry)",
+                    this->net_requests.load(), this->net_reused.load(), this->net_retries.load(),
+                    this->net_retry_wait_ms.load());
+
+    curl_share_cleanup(this->curl_share);
+}
+
+/** Prepares a session to use the backend connection pool.
+ * Keep-alive connections, TLS sessions and DNS entries are shared between every session,
+ * and HTTP/2 is used when the server offers it.
+ * The request times out after config.connectTimeout/config.requestTimeout, and gets cancelled on CTRL-C.
+ * @param session the session to prepare
+ * @param url the url to request
+ */
+void TaurBackend::setup_session(cpr::Session& session, const std::string_view url)
+{
+    session.SetUrl(cpr::Url(url));
+    session.SetHttpVersion(cpr::HttpVersion{ cpr::HttpVersionCode::VERSION_2_0_TLS });
+    session.SetConnectTimeout(cpr::ConnectTimeout{ std::chrono::seconds(config.connectTimeout) });
+    session.SetTimeout(cpr::Timeout{ std::chrono::seconds(config.requestTimeout) });
+    session.SetProgressCallback(cpr::ProgressCallback{
+        [](curl_off_t, curl_off_t, curl_off_t, curl_off_t, intptr_t) -> bool { return !net_interrupted; } });
+
+    CURL* handle = session.GetCurlHolder()->handle;
+    curl_easy_setopt(handle, CURLOPT_SHARE, this->curl_share);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+}
+
+// CURLINFO_NUM_CONNECTS is 0 if the previous transfer reused a connection from the pool
+void TaurBackend::count_connection(CURL* handle)
+{
+    long new_connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &new_connects);
+
+    this->net_requests++;
+    if (new_connects == 0)
+        this->net_reused++;
+
+    log_println(DEBUG, "connection {} (requests = {}, reused = {})", new_connects == 0 ? "reused" : "opened",
+                this->net_requests.load(), this->net_reused.load());
+}
+
+/** Returns the AUR endpoint to use, e.g "https://aur.archlinux.org" (without a trailing slash).
+ * If more than one endpoint is configured, they're probed the first time this is called.
+ */
+std::string TaurBackend::aur_url()
+{
+    if (this->endpoints.size() > 1 && !config.offline)
+        std::call_once(this->endpoints_probed, &TaurBackend::probe_endpoints, this);
+
+    std::lock_guard<std::mutex> lock(this->endpoints_mutex);
+    return this->endpoints.front();
+}
+
+// sends a small RPC request to every endpoint at once, and sorts them by how fast they answered it.
+void TaurBackend::probe_endpoints()
+{
+    std::vector<HttpResponse_t> probes(this->endpoints.size());
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        probes[i].url   = this->endpoints[i] + "/rpc/v5/info";
+        probes[i].retry = false;
+    }
+
+    this->http_perform_multi(probes);
+
+    std::vector<std::pair<double, std::string>> latencies;
+    for (size_t i = 0; i < probes.size(); i++)
+    {
+        const bool healthy = probes[i].status_code == 200;
+        log_println(DEBUG, "endpoint {}: {} in {:.3f}s", this->endpoints[i], healthy ? "answered" : "failed", probes[i].elapsed);
+
+        latencies.emplace_back(healthy ? probes[i].elapsed : std::numeric_limits<double>::infinity(), this->endpoints[i]);
+    }
+
+    std::stable_sort(latencies.begin(), latencies.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    if (latencies.front().first == std::numeric_limits<double>::infinity())
+        log_println(WARN, _("None of the AUR endpoints answered, still trying {}"), latencies.front().second);
+
+    std::lock_guard<std::mutex> lock(this->endpoints_mutex);
+    for (size_t i = 0; i < latencies.size(); i++)
+        this->endpoints[i] = std::move(latencies[i].second);
+}
+
+/** Moves a request off an endpoint that failed it.
+ * The endpoint goes to the back of the list, so the next requests use another one too.
+ * @param url the url of the failed request
+ * @return the same request on the endpoint to use now, or url if there's nothing to fail over to
+ */
+std::string TaurBackend::failover_url(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(this->endpoints_mutex);
+    if (this->endpoints.size() < 2)
+        return url;
+
+    for (auto it = this->endpoints.begin(); it != this->endpoints.end(); it++)
+    {
+        if (!hasStart(url, *it + '/'))
+            continue;
+
+        if (it == this->endpoints.begin())
+        {
+            std::rotate(this->endpoints.begin(), this->endpoints.begin() + 1, this->endpoints.end());
+            log_println(WARN, _("{} isn't answering, switching to {}"), this->endpoints.back(), this->endpoints.front());
+        }
+
+        return this->endpoints.front() + url.substr(it->length());
+    }
+
+    return url;
+}
+
+// whether a request that got this response is worth trying again
+static bool isRetryable(const long status_code, const bool transfer_failed)
+{ return transfer_failed || status_code == 429 || (status_code >= 500 && status_code < 600); }
+
+// how long to wait before a retry: exponential backoff, randomized so concurrent retries don't come back all at once
+static std::chrono::milliseconds getRetryDelay(const int attempt)
+{
+    thread_local std::mt19937 rng(std::random_device{}());
+
+    const int64_t max = static_cast<int64_t>(config->retryDelay) << std::min(attempt, 10);
+    return std::chrono::milliseconds(std::uniform_int_distribution<int64_t>(max / 2, max)(rng));
+}
+
+/** Decides whether a failed request gets another try, and records it.
+ * @param attempt how many times the request was retried already
+ * @param url the url of the request, for logging
+ * @param reason why it failed, for logging
+ * @return how long to wait before retrying, or nothing if it's time to give up
+ */
+std::optional<std::chrono::milliseconds> TaurBackend::plan_retry(const int attempt, const std::string_view url, const std::string_view reason)
+{
+    if (attempt >= config.maxRetries || net_interrupted)
+        return {};
+
+    const std::chrono::milliseconds delay = getRetryDelay(attempt);
+    log_println(DEBUG, "retrying {} in {}ms ({}, attempt {}/{})", url, delay.count(), reason, attempt + 1, config.maxRetries);
+
+    this->net_retries++;
+    this->net_retry_wait_ms += delay.count();
+    return delay;
+}
+
+// sleeps, waking up early on CTRL-C
+static void sleep_interruptible(const std::chrono::milliseconds delay)
+{
+    const auto& until = std::chrono::steady_clock::now() + delay;
+    while (!net_interrupted && std::chrono::steady_clock::now() < until)
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(until - std::chrono::steady_clock::now(),
+                                                                                 std::chrono::milliseconds(50)));
+}
+
+/** Performs a GET request, retried like the ones of http_perform_multi().
+ * @param url the url to request
+ * @param headers extra request headers
+ * @param on_data if set, the body is handed to it as it arrives instead of being stored in the response text,
+ *                returning false aborts the transfer. Once some of the body was handed over, the request isn't retried.
+ */
+cpr::Response TaurBackend::http_get(const std::string_view url, const cpr::Header& headers,
+                                    const std::function<bool(std::string_view)>& on_data)
+{
+    if (config.offline)
+    {
+        log_println(DEBUG, "offline, not requesting {}", url);
+        cpr::Response r;
+        r.url           = cpr::Url(std::string(url));
+        r.error.code    = cpr::ErrorCode::UNKNOWN_ERROR;
+        r.error.message = _("not available offline");
+        return r;
+    }
+
+    cpr::Session session;
+    this->setup_session(session, url);
+    session.SetHeader(headers);
+
+    std::string current_url(url);
+
+    // error responses that we're going to retry shouldn't end up in on_data
+    int  attempt = 0;
+    bool started = false, discard = false;
+    if (on_data)
+    {
+        session.SetWriteCallback(cpr::WriteCallback{ [&](const std::string_view data, intptr_t) {
+            if (!started)
+            {
+                started          = true;
+                long status_code = 0;
+                curl_easy_getinfo(session.GetCurlHolder()->handle, CURLINFO_RESPONSE_CODE, &status_code);
+                discard = isRetryable(status_code, false) && attempt < config.maxRetries;
+            }
+
+            return discard || on_data(data);
+        } });
+    }
+
+    net_transfers++;
+    cpr::Response r;
+    for (;; attempt++)
+    {
+        started = discard = false;
+        r = session.Get();
+        this->count_connection(session.GetCurlHolder()->handle);
+
+        const bool failed    = r.error.code != cpr::ErrorCode::OK && r.error.code != cpr::ErrorCode::REQUEST_CANCELLED;
+        const bool body_used = started && !discard;
+        if ((on_data && body_used) || !isRetryable(r.status_code, failed))
+            break;
+
+        const auto& delay = this->plan_retry(attempt, current_url, failed ? r.error.message : fmt::to_string(r.status_code));
+        if (!delay)
+            break;
+
+        sleep_interruptible(*delay);
+        current_url = this->failover_url(current_url);
+        session.SetUrl(cpr::Url(current_url));
+    }
+    net_transfers--;
+
+    exitIfInterrupted();
+
+    return r;
+}
+
+// a transfer of http_perform_multi(), what the curl callbacks get
+struct multi_transfer_t
+{
+    HttpResponse_t* resp;
+    CURL*           handle  = nullptr;
+    int             attempt = 0;
+    bool            discard = false;  // this body won't be used, because the request will be retried
+    bool            started = false;
+    bool            paused  = false;  // until resp->ready()
+};
+
+static size_t curl_write_response(char* ptr, size_t size, size_t nmemb, void* userdata)
+{
+    multi_transfer_t* transfer = reinterpret_cast<multi_transfer_t*>(userdata);
+    HttpResponse_t*   resp     = transfer->resp;
+
+    // error responses that we're going to retry shouldn't end up in the consumer.
+    if (!transfer->started)
+    {
+        transfer->started = true;
+        long status_code  = 0;
+        curl_easy_getinfo(transfer->handle, CURLINFO_RESPONSE_CODE, &status_code);
+        transfer->discard = resp->retry && isRetryable(status_code, false) && transfer->attempt < config->maxRetries;
+    }
+
+    if (transfer->discard)
+        return size * nmemb;
+
+    // curl hands the same data again once the transfer is resumed
+    if (resp->ready && !resp->ready())
+    {
+        transfer->paused = true;
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    if (resp->on_data)
+        resp->on_data(std::string_view(ptr, size * nmemb));
+    else
+        resp->text.append(ptr, size * nmemb);
+
+    return size * nmemb;
+}
+
+static int curl_xferinfo_cancel(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{ return net_interrupted || static_cast<HttpResponse_t*>(clientp)->stop.stop_requested() ? 1 : 0; }
+
+/** Performs multiple GET requests at once using curl's multi interface.
+ * At most config.maxConcurrentRequests transfers are in flight at the same time,
+ * and every transfer uses the backend connection pool.
+ * Requests that fail before any of their body was used, get a 5xx or 429, are retried with backoff
+ * up to config.maxRetries times. A transfer is cancelled once a stop is requested on its stop token.
+ * On CTRL-C every transfer is cancelled, then taur exits if this is the main thread,
+ * else the cancelled ones are returned with an error.
+ * @param transfers the requests to perform, each one needs its url set,
+ *                  the body goes to on_data as it arrives if set, else to text.
+ *                  A transfer whose ready() returns false is paused until it returns true.
+ */
+void TaurBackend::http_perform_multi(std::vector<HttpResponse_t>& transfers)
+{
+    if (transfers.empty())
+        return;
+
+    if (config.offline)
+    {
+        for (HttpResponse_t& transfer : transfers)
+        {
+            log_println(DEBUG, "offline, not requesting {}", transfer.url);
+            transfer.error = _("not available offline");
+        }
+        return;
+    }
+
+    CURLM* multi = curl_multi_init();
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    std::vector<multi_transfer_t> states(transfers.size());
+    size_t                        next = 0, running = 0, rpc_sent = 0;
+
+    // (when, transfer index) of the requests waiting to be retried
+    std::vector<std::pair<std::chrono::steady_clock::time_point, size_t>> retries;
+
+    const auto& add_transfer = [&](const size_t i) {
+        CURL*             handle   = curl_easy_init();
+        multi_transfer_t& transfer = states[i];
+        transfer.resp              = &transfers[i];
+        transfer.handle            = handle;
+        transfer.started           = false;
+        transfer.paused            = false;
+
+        curl_easy_setopt(handle, CURLOPT_URL, transfers[i].url.c_str());
+        curl_easy_setopt(handle, CURLOPT_SHARE, this->curl_share);
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+        curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+        curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, static_cast<long>(config.connectTimeout));
+        curl_easy_setopt(handle, CURLOPT_TIMEOUT, static_cast<long>(config.requestTimeout));
+        curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, curl_xferinfo_cancel);
+        curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &transfers[i]);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, curl_write_response);
+        curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer);
+        curl_easy_setopt(handle, CURLOPT_PRIVATE, &transfer);
+
+        curl_multi_add_handle(multi, handle);
+        running++;
+    };
+
+    const auto& has_free_slot = [&]() { return running < static_cast<size_t>(config.maxConcurrentRequests); };
+
+    net_transfers++;
+    while (next < transfers.size() && has_free_slot())
+        add_transfer(next++);
+
+    int still_running = 0;
+    do
+    {
+        if (curl_multi_perform(multi, &still_running) != CURLM_OK)
+            break;
+
+        CURLMsg* msg;
+        int      msgs_left;
+        while ((msg = curl_multi_info_read(multi, &msgs_left)))
+        {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+
+            CURL*             handle = msg->easy_handle;
+            multi_transfer_t* transfer;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, &transfer);
+
+            HttpResponse_t* resp   = transfer->resp;
+            const CURLcode  result = msg->data.result;
+            double          elapsed;
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &resp->status_code);
+            curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &elapsed);
+            resp->elapsed += elapsed;
+            resp->error = result != CURLE_OK ? curl_easy_strerror(result) : "";
+
+            this->count_connection(handle);
+            if (resp->url.find("/rpc") != std::string::npos)
+                rpc_sent++;
+
+            curl_multi_remove_handle(multi, handle);
+            curl_easy_cleanup(handle);
+            transfer->handle = nullptr;
+            transfer->paused = false;
+            running--;
+
+            // a failed transfer that already handed some of its body to on_data can't be started over
+            const bool failed      = result != CURLE_OK && result != CURLE_ABORTED_BY_CALLBACK;
+            const bool body_used   = transfer->started && !transfer->discard && resp->on_data;
+            const bool can_restart = resp->retry && !body_used && isRetryable(resp->status_code, failed);
+
+            const auto& delay = can_restart ? this->plan_retry(transfer->attempt, resp->url, failed ? resp->error : fmt::to_string(resp->status_code))
+                                            : std::nullopt;
+            if (delay)
+            {
+                retries.emplace_back(std::chrono::steady_clock::now() + *delay, transfer - states.data());
+                transfer->attempt++;
+                resp->retries++;
+                resp->text.clear();
+                resp->url = this->failover_url(resp->url);
+            }
+            else if (resp->on_done)
+                resp->on_done();
+        }
+
+        // resume the transfers whose consumer caught up
+        bool paused = false;
+        for (multi_transfer_t& transfer : states)
+        {
+            if (!transfer.paused || !transfer.handle)
+                continue;
+
+            if (transfer.resp->ready())
+            {
+                transfer.paused = false;
+                curl_easy_pause(transfer.handle, CURLPAUSE_CONT);
+            }
+            paused |= transfer.paused;
+        }
+
+        // retries first, they've been waiting already
+        const auto& now = std::chrono::steady_clock::now();
+        for (auto it = retries.begin(); it != retries.end() && has_free_slot() && !net_interrupted;)
+        {
+            if (it->first <= now)
+            {
+                add_transfer(it->second);
+                it = retries.erase(it);
+            }
+            else
+                it++;
+        }
+
+        while (next < transfers.size() && has_free_slot() && !net_interrupted)
+            add_transfer(next++);
+
+        // a paused transfer doesn't wake the poll up, so check on it sooner
+        if (running > 0)
+            curl_multi_poll(multi, nullptr, 0, paused ? 5 : 100, nullptr);
+        else if (!retries.empty() && !net_interrupted)
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    } while (running > 0 || (!retries.empty() && !net_interrupted));
+
+    curl_multi_cleanup(multi);
+    net_transfers--;
+
+    this->record_rpc_requests(rpc_sent);
+
+    // CTRL-C left these never started, or waiting for a retry
+    for (size_t i = next; i < transfers.size(); ++i)
+        transfers[i].error = _("interrupted");
+    for (const auto& retry : retries)
+        transfers[retry.second].error = _("interrupted");
+
+    exitIfInterrupted();
+}
+
+/** Performs multiple GET requests at once, see http_perform_multi().
+ * @param urls the urls to request
+ * @return the responses, in the same order as urls
+ */
+std::vector<HttpResponse_t> TaurBackend::http_get_multi(std::vector<std::string> const& urls)
+{
+    std::vector<HttpResponse_t> out(urls.size());
+    for (size_t i = 0; i < urls.size(); i++)
+        out[i].url = urls[i];
+
+    this->http_perform_multi(out);
+
+    return out;
+}
+
+// drop the endpoint and sort the query parameters, so the same query always maps to the same cache entry,
+// whichever AUR endpoint answered it.
+static std::string normalizeRpcUrl(const std::string& url)
+{
+    const size_t scheme_pos = url.find("://");
+    const size_t path_pos   = url.find('/', scheme_pos == std::string::npos ? 0 : scheme_pos + "://"_len);
+    const std::string& path = path_pos == std::string::npos ? url : url.substr(path_pos);
+
+    const size_t query_pos = path.find('?');
+    if (query_pos == std::string::npos)
+        return path;
+
+    std::vector<std::string> params = split(path.substr(query_pos + 1), '&');
+    std::sort(params.begin(), params.end());
+
+    return fmt::format("{}?{}", path.substr(0, query_pos), fmt::join(params, "&"));
+}
+
+static path getRpcCachePath(const std::string_view key)
+{ return config->cacheDir / "rpc" / fmt::format("{:016x}", fnv1a64::hash(key)); }
+
+/* The AUR only allows so many RPC requests per IP and day, so every request we send is counted in
+ * cacheDir/rpc_budget, shared by every taur process (and user of the cache) through flock().
+ * Each line is "<hour since epoch> <requests>", only the last 24 hours are kept.
+ */
+static path getRpcBudgetPath()
+{ return config->cacheDir / "rpc_budget"; }
+
+// parses the budget file, dropping the hours that aren't in the last day anymore.
+static std::vector<std::pair<int64_t, size_t>> readRpcBudget(const int fd, const int64_t current_hour)
+{
+    std::string content;
+    char        buf[4096];
+    ssize_t     len;
+
+    lseek(fd, 0, SEEK_SET);
+    while ((len = read(fd, buf, sizeof(buf))) > 0)
+        content.append(buf, len);
+
+    std::vector<std::pair<int64_t, size_t>> hours;
+    std::istringstream                      stream(content);
+    int64_t                                 hour;
+    size_t                                  count;
+    while (stream >> hour >> count)
+        if (hour > current_hour - 24 && hour <= current_hour)
+            hours.emplace_back(hour, count);
+
+    return hours;
+}
+
+/** Counts RPC requests against the daily budget.
+ * @param requests how many requests were sent
+ */
+void TaurBackend::record_rpc_requests(const size_t requests)
+{
+    if (requests == 0)
+        return;
+
+    std::error_code err;
+    std::filesystem::create_directories(config.cacheDir, err);
+
+    const int fd = open(getRpcBudgetPath().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0 || flock(fd, LOCK_EX) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        log_println(DEBUG, "failed to record {} RPC requests: {}", requests, strerror(errno));
+        return;
+    }
+
+    const int64_t current_hour = std::time(nullptr) / 3600;
+    auto          hours        = readRpcBudget(fd, current_hour);
+
+    if (!hours.empty() && hours.back().first == current_hour)
+        hours.back().second += requests;
+    else
+        hours.emplace_back(current_hour, requests);
+
+    std::string content;
+    for (const auto& [hour, count] : hours)
+        content += fmt::format("{} {}\n", hour, count);
+
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, content.data(), content.size(), 0) != static_cast<ssize_t>(content.size()))
+        log_println(DEBUG, "failed to write {}: {}", getRpcBudgetPath().string(), strerror(errno));
+
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+// returns how many RPC requests were sent in the last 24 hours
+size_t TaurBackend::rpc_budget_used()
+{
+    const int fd = open(getRpcBudgetPath().c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    size_t used = 0;
+    if (flock(fd, LOCK_SH) == 0)
+    {
+        for (const auto& [hour, count] : readRpcBudget(fd, std::time(nullptr) / 3600))
+            used += count;
+        flock(fd, LOCK_UN);
+    }
+
+    close(fd);
+    return used;
+}
+
+/** Checks whether we're close to running out of RPC requests for today (less than a tenth of config.rpcBudget left).
+ * When it is, lookups are batched and cached answers are used whatever their age.
+ */
+bool TaurBackend::rpc_budget_low()
+{
+    if (config.rpcBudget <= 0)
+        return false;
+
+    const size_t used = this->rpc_budget_used();
+    const bool   low  = used + config.rpcBudget / 10 >= static_cast<size_t>(config.rpcBudget);
+
+    if (low && !this->rpc_budget_warned.exchange(true))
+        log_println(WARN, _("Only {} of {} AUR requests left for today, preferring cached answers"),
+                    used >= static_cast<size_t>(config.rpcBudget) ? 0 : config.rpcBudget - used, config.rpcBudget);
+
+    return low;
+}
+
+// the first line of a cache entry is its key, so a hash collision is a miss instead of a wrong answer.
+static bool openRpcCache(const std::string_view key, std::ifstream& file, std::time_t& mtime)
+{
+    const path& file_path = getRpcCachePath(key);
+    std::string file_key;
+
+    file.open(file_path);
+    if (!file.good() || !std::getline(file, file_key) || file_key != key)
+        return false;
+
+    struct stat file_stat;
+    if (stat(file_path.c_str(), &file_stat) != 0)
+        return false;
+    mtime = file_stat.st_mtim.tv_sec;
+
+    return true;
+}
+
+// searches can be answered a bit late, see rpc_get()
+static bool isRpcSearch(const std::string_view url)
+{ return url.find("type=search") != url.npos || url.find("/rpc/v5/search/") != url.npos; }
+
+static bool isRpcResponseCacheable(const long status_code, const std::string_view type)
+{ return status_code == 200 && type != "error"; }
+
+// written to a temporary file first then renamed, so other taur processes never read a partial entry.
+static std::string getRpcCacheTmpPath(const std::string_view key)
+{
+    const path& file_path = getRpcCachePath(key);
+
+    std::error_code err;
+    std::filesystem::create_directories(file_path.parent_path(), err);
+
+    return fmt::format("{}.{}.tmp", file_path.string(), gettid());
+}
+
+static void publishRpcCache(const std::string_view key, const std::string& tmp_path, const bool keep)
+{
+    std::error_code err;
+    if (!keep || rename(tmp_path.c_str(), getRpcCachePath(key).c_str()) != 0)
+        std::filesystem::remove(tmp_path, err);
+}
+
+static void writeRpcCache(const std::string_view key, const HttpResponse_t& resp)
+{
+    if (!isRpcResponseCacheable(resp.status_code, "") || resp.text.empty() ||
+        resp.text.find("\"type\":\"error\"") != std::string::npos)
+        return;
+
+    const std::string& tmp_path = getRpcCacheTmpPath(key);
+    std::ofstream      file(tmp_path, std::ios::trunc);
+    if (!file.is_open())
+        return;
+
+    file << key << '\n' << resp.text;
+    file.close();
+
+    publishRpcCache(key, tmp_path, true);
+}
+
+/* A SAX handler that builds package records from an AUR RPC response, while it's being read.
+ * The response looks like {"resultcount": N, "results": [{...}, ...], "type": "...", "version": 5}
+ * depth 1 is the response object, 2 the results array, 3 a package and 4 an array in a package (e.g Depends).
+ * With Pkg_t = TaurPkg_t every string is copied, with Pkg_t = TaurPkgView_t they are only referenced,
+ * so the input has to be parsed in place (kParseInsituFlag) and outlive the records.
+ * Fields that are not in the pkg_fields mask are skipped without being decoded.
+ */
+template <typename Pkg_t>
+class RpcPkgHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, RpcPkgHandler<Pkg_t>>
+{
+public:
+    static constexpr bool isView = std::is_same_v<Pkg_t, TaurPkgView_t>;
+
+    std::vector<Pkg_t>            pkgs;
+    std::vector<std::string_view> lists;  // only used by views, every list element of every package
+    std::string                   type, error;
+
+    explicit RpcPkgHandler(const bool returnGit = false, const int fields = PKG_FIELDS_ALL, const std::string_view base_url = "")
+        : returnGit(returnGit), fields(fields), base_url(base_url)
+    {}
+
+    bool StartObject()
+    {
+        if (++depth == 3 && in_results)
+            pkg = { .maintainer = "\1" };  // it's impossible that the maintainer name is a binary char
+
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        if (depth-- == 3 && in_results)
+            this->finishPkg();
+
+        field = RPC_FIELD_NONE;
+        return true;
+    }
+
+    bool StartArray()
+    {
+        if (++depth == 2 && field == RPC_FIELD_RESULTS)
+            in_results = true;
+
+        if constexpr (isView)
+            if (depth == 4 && in_results && field >= RPC_FIELD_DEPENDS)
+                list_ranges.back()[field - RPC_FIELD_DEPENDS].first = lists.size();
+
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        if (depth-- == 2)
+            in_results = false;
+
+        field = RPC_FIELD_NONE;
+        return true;
+    }
+
+    bool Key(const char* str, rapidjson::SizeType len, bool)
+    {
+        if (depth == 1 || depth == 3)
+        {
+            field = getField(std::string_view(str, len));
+            if (!(fields & getFieldMask(field)))
+                field = RPC_FIELD_NONE;
+        }
+
+        return true;
+    }
+
+    bool String(const char* str, rapidjson::SizeType len, bool)
+    {
+        const std::string_view value(str, len);
+
+        if (depth == 1 && field == RPC_FIELD_TYPE)
+            type = value;
+        else if (depth == 1 && field == RPC_FIELD_ERROR)
+            error = value;
+        else if (depth == 3 && in_results)
+        {
+            switch (field)
+            {
+                case RPC_FIELD_NAME:        pkg.name = value; break;
+                case RPC_FIELD_VERSION:     pkg.version = value; break;
+                case RPC_FIELD_DESCRIPTION: pkg.desc = value; break;
+                case RPC_FIELD_URL:         pkg.url = value; break;
+                case RPC_FIELD_URLPATH:     url_path = value; break;
+                case RPC_FIELD_MAINTAINER:  pkg.maintainer = value; break;
+                default:                    break;
+            }
+        }
+        else if (depth == 4 && in_results && field >= RPC_FIELD_DEPENDS)
+        {
+            if constexpr (isView)
+            {
+                lists.push_back(value);
+                list_ranges.back()[field - RPC_FIELD_DEPENDS].second++;
+            }
+            else
+            {
+                switch (field)
+                {
+                    case RPC_FIELD_DEPENDS:     pkg.depends.emplace_back(value); break;
+                    case RPC_FIELD_MAKEDEPENDS: pkg.makedepends.emplace_back(value); break;
+                    case RPC_FIELD_LICENSE:     pkg.licenses.emplace_back(value); break;
+                    default:                    break;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    bool Int(int i) { return this->Number(i); }
+    bool Uint(unsigned u) { return this->Number(u); }
+    bool Int64(int64_t i) { return this->Number(i); }
+    bool Uint64(uint64_t u) { return this->Number(u); }
+    bool Double(double d) { return this->Number(d); }
+
+    // points the list spans of the views into lists, once it won't grow anymore.
+    void bindLists()
+    {
+        if constexpr (isView)
+        {
+            for (size_t i = 0; i < pkgs.size(); i++)
+            {
+                const auto& ranges  = list_ranges[i];
+                pkgs[i].depends     = { lists.data() + ranges[0].first, ranges[0].second };
+                pkgs[i].makedepends = { lists.data() + ranges[1].first, ranges[1].second };
+                pkgs[i].licenses    = { lists.data() + ranges[2].first, ranges[2].second };
+            }
+        }
+    }
+
+private:
+    enum rpc_field
+    {
+        RPC_FIELD_NONE,
+        RPC_FIELD_RESULTS,
+        RPC_FIELD_TYPE,
+        RPC_FIELD_ERROR,
+        RPC_FIELD_NAME,
+        RPC_FIELD_VERSION,
+        RPC_FIELD_DESCRIPTION,
+        RPC_FIELD_URL,
+        RPC_FIELD_URLPATH,
+        RPC_FIELD_MAINTAINER,
+        RPC_FIELD_LASTMODIFIED,
+        RPC_FIELD_OUTOFDATE,
+        RPC_FIELD_POPULARITY,
+        RPC_FIELD_NUMVOTES,
+        // the lists, keep them last and in this order
+        RPC_FIELD_DEPENDS,
+        RPC_FIELD_MAKEDEPENDS,
+        RPC_FIELD_LICENSE,
+    };
+
+    using url_path_t = std::conditional_t<isView, std::string_view, std::string>;
+
+    const bool        returnGit;
+    const int         fields;
+    const std::string base_url;  // the AUR endpoint, for aur_url
+    Pkg_t             pkg;
+    url_path_t url_path;
+    rpc_field  field      = RPC_FIELD_NONE;
+    int        depth      = 0;
+    bool       in_results = false;
+
+    // (offset in lists, count) of depends, makedepends and licenses, for each view.
+    std::vector<std::array<std::pair<size_t, size_t>, 3>> list_ranges = decltype(list_ranges)(1);
+
+    rpc_field getField(const std::string_view key) const
+    {
+        switch (fnv1a32::hash(key))
+        {
+            case "results"_fnv1a32:      return depth == 1 ? RPC_FIELD_RESULTS : RPC_FIELD_NONE;
+            case "type"_fnv1a32:         return depth == 1 ? RPC_FIELD_TYPE : RPC_FIELD_NONE;
+            case "error"_fnv1a32:        return depth == 1 ? RPC_FIELD_ERROR : RPC_FIELD_NONE;
+            case "Name"_fnv1a32:         return RPC_FIELD_NAME;
+            case "Version"_fnv1a32:      return RPC_FIELD_VERSION;
+            case "Description"_fnv1a32:  return RPC_FIELD_DESCRIPTION;
+            case "URL"_fnv1a32:          return RPC_FIELD_URL;
+            case "URLPath"_fnv1a32:      return RPC_FIELD_URLPATH;
+            case "Maintainer"_fnv1a32:   return RPC_FIELD_MAINTAINER;
+            case "LastModified"_fnv1a32: return RPC_FIELD_LASTMODIFIED;
+            case "OutOfDate"_fnv1a32:    return RPC_FIELD_OUTOFDATE;
+            case "Popularity"_fnv1a32:   return RPC_FIELD_POPULARITY;
+            case "NumVotes"_fnv1a32:     return RPC_FIELD_NUMVOTES;
+            case "Depends"_fnv1a32:      return RPC_FIELD_DEPENDS;
+            case "MakeDepends"_fnv1a32:  return RPC_FIELD_MAKEDEPENDS;
+            case "License"_fnv1a32:      return RPC_FIELD_LICENSE;
+        }
+
+        return RPC_FIELD_NONE;
+    }
+
+    static int getFieldMask(const rpc_field field)
+    {
+        switch (field)
+        {
+            case RPC_FIELD_NAME:         return PKG_FIELD_NAME;
+            case RPC_FIELD_VERSION:      return PKG_FIELD_VERSION;
+            case RPC_FIELD_DESCRIPTION:  return PKG_FIELD_DESC;
+            case RPC_FIELD_URL:          return PKG_FIELD_URL;
+            case RPC_FIELD_URLPATH:      return PKG_FIELD_AUR_URL;
+            case RPC_FIELD_MAINTAINER:   return PKG_FIELD_MAINTAINER;
+            case RPC_FIELD_LASTMODIFIED: return PKG_FIELD_LAST_MODIFIED;
+            case RPC_FIELD_OUTOFDATE:    return PKG_FIELD_OUTOFDATE;
+            case RPC_FIELD_POPULARITY:   return PKG_FIELD_POPULARITY;
+            case RPC_FIELD_NUMVOTES:     return PKG_FIELD_VOTES;
+            case RPC_FIELD_DEPENDS:      return PKG_FIELD_DEPENDS;
+            case RPC_FIELD_MAKEDEPENDS:  return PKG_FIELD_MAKEDEPENDS;
+            case RPC_FIELD_LICENSE:      return PKG_FIELD_LICENSES;
+            default:                     return PKG_FIELDS_ALL;  // the response fields (results, type, error)
+        }
+    }
+
+    template <typename T>
+    bool Number(const T value)
+    {
+        if (depth != 3 || !in_results)
+            return true;
+
+        switch (field)
+        {
+            case RPC_FIELD_LASTMODIFIED: pkg.last_modified = value; break;
+            case RPC_FIELD_OUTOFDATE:    pkg.outofdate = value; break;
+            case RPC_FIELD_POPULARITY:   pkg.popularity = value; break;
+            case RPC_FIELD_NUMVOTES:     pkg.votes = value; break;
+            default:                     break;
+        }
+
+        return true;
+    }
+
+    void finishPkg()
+    {
+        if constexpr (isView)
+        {
+            pkg.url_path = url_path;
+            list_ranges.emplace_back();
+        }
+        else
+        {
+            // URLPath starts with a /
+            if (fields & PKG_FIELD_AUR_URL)
+                pkg.aur_url = returnGit ? AUR_URL_GIT(base_url, pkg.name) : fmt::format("{}{}", base_url, url_path);
+
+            pkg.totaldepends.reserve(pkg.depends.size() + pkg.makedepends.size());
+            pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.depends.begin(), pkg.depends.end());
+            pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.makedepends.begin(), pkg.makedepends.end());
+        }
+
+        pkgs.push_back(std::move(pkg));
+        url_path = {};
+    }
+};
+
+/* A rapidjson input stream that gets fed chunks from the curl write callback, on another thread.
+ * Peek() and Take() block until there's more data, or until finish() is called (then they return '\0').
+ * It buffers up to max_buffered bytes: the writer checks full() (to pause its transfer) or uses push_wait().
+ * Once the reader is done with it, close() makes it drop whatever is pushed, so a writer never waits on nobody.
+ */
+class RpcChunkStream
+{
+public:
+    typedef char Ch;
+
+    static constexpr size_t max_buffered = 1 << 20;
+
+    void push(const std::string_view chunk)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed)
+                return;
+            chunks.emplace_back(chunk);
+            buffered += chunk.size();
+        }
+        cond.notify_one();
+    }
+
+    // like push(), but waits for the reader to catch up first
+    void push_wait(const std::string_view chunk)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space.wait(lock, [this] { return buffered < max_buffered || closed; });
+        }
+        this->push(chunk);
+    }
+
+    bool full() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return buffered >= max_buffered && !closed;
+    }
+
+    void finish()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        cond.notify_one();
+    }
+
+    // called by the reader once it stopped reading
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed   = true;
+            buffered = 0;
+            chunks.clear();
+        }
+        space.notify_all();
+    }
+
+    Ch Peek() const { return (pos < current.size() || this->nextChunk()) ? current[pos] : '\0'; }
+
+    Ch Take()
+    {
+        const Ch c = this->Peek();
+        if (c != '\0')
+        {
+            pos++;
+            count++;
+        }
+        return c;
+    }
+
+    size_t Tell() const { return count; }
+
+    // not an output stream
+    Ch*    PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+    void   Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void   Flush() { RAPIDJSON_ASSERT(false); }
+    size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+
+private:
+    mutable std::mutex              mutex;
+    mutable std::condition_variable cond, space;
+    mutable std::deque<std::string> chunks;
+    mutable std::string             current;
+    mutable size_t                  pos      = 0;
+    mutable size_t                  buffered = 0;
+    size_t                          count    = 0;
+    bool                            done     = false;
+    bool                            closed   = false;
+
+    bool nextChunk() const
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        do
+        {
+            cond.wait(lock, [this] { return !chunks.empty() || done; });
+            if (chunks.empty())
+                return false;
+
+            current = std::move(chunks.front());
+            chunks.pop_front();
+            buffered -= current.size();
+            space.notify_one();
+        } while (current.empty());
+
+        pos = 0;
+        return true;
+    }
+};
+
+/* Parses an RPC response on its own thread while it's downloading.
+ * The thread starts with the first chunk of the body, and ends with finish(),
+ * so there's one only for the transfers that are in flight.
+ */
+class RpcStreamParser
+{
+public:
+    RpcPkgHandler<TaurPkg_t> handler;
+
+    RpcStreamParser(const bool returnGit, const int fields, const std::string_view base_url)
+        : handler(returnGit, fields, base_url)
+    {}
+
+    void push(const std::string_view data)
+    {
+        if (!thread.joinable() && !finished)
+            thread = std::thread([this]() {
+                rapidjson::Reader reader;
+                result = reader.Parse(stream, handler);
+                stream.close();
+            });
+
+        stream.push(data);
+    }
+
+    // whether push() should wait, see RpcChunkStream
+    bool ready() const { return !stream.full(); }
+
+    // waits for the parser to read everything that was pushed, returns whether it parsed successfully.
+    bool finish()
+    {
+        stream.finish();
+        if (thread.joinable())
+        {
+            thread.join();
+            parsed = !result.IsError();
+        }
+        finished = true;
+        return parsed;
+    }
+
+    ~RpcStreamParser() { this->finish(); }
+
+private:
+    RpcChunkStream         stream;
+    rapidjson::ParseResult result;
+    std::thread            thread;
+    bool                   finished = false, parsed = false;
+};
+
+/** Decodes an RPC response that arrives in chunks, like rpc_get() does while it downloads:
+ * the chunks are parsed on another thread as they're handed over.
+ * @param chunks the response, split anywhere
+ * @return the packages, type and error of the response. status_code is 200 if it parsed, else 0
+ */
+RpcResult_t parseRpcChunks(std::span<const std::string_view> chunks, const bool returnGit, const int fields, const std::string_view base_url)
+{
+    RpcStreamParser parser(returnGit, fields, base_url);
+    for (const std::string_view chunk : chunks)
+        parser.push(chunk);
+
+    if (!parser.finish())
+        return {};
+
+    return { .pkgs        = std::move(parser.handler.pkgs),
+             .type        = std::move(parser.handler.type),
+             .error       = std::move(parser.handler.error),
+             .status_code = 200 };
+}
+
+/* A SAX handler for the AUR metadata dump (packages-meta-ext-v1.json.gz), it's one big array of packages like
+ * [{"Name": "...", "Version": "...", "Provides": ["...", ...], ...}, ...]
+ * depth 1 is the array, 2 a package and 3 an array in a package. on_pkg gets called for each package as soon as it ends.
+ */
+class AurMetaHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, AurMetaHandler>
+{
+public:
+    explicit AurMetaHandler(std::function<void(const AurMetaPkg_t&)> on_pkg) : on_pkg(std::move(on_pkg)) {}
+
+    bool StartObject()
+    {
+        if (++depth == 2)
+            pkg = {};
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType)
+    {
+        if (depth-- == 2 && !pkg.name.empty())
+            on_pkg(pkg);
+
+        field = FIELD_NONE;
+        return true;
+    }
+
+    bool StartArray()
+    {
+        ++depth;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType)
+    {
+        --depth;
+        field = FIELD_NONE;
+        return true;
+    }
+
+    bool Key(const char* str, rapidjson::SizeType length, bool)
+    {
+        if (depth != 2)
+            return true;
+
+        switch (fnv1a32::hash(str, length))
+        {
+            case "Name"_fnv1a32:         field = FIELD_NAME; break;
+            case "Version"_fnv1a32:      field = FIELD_VERSION; break;
+            case "Description"_fnv1a32:  field = FIELD_DESCRIPTION; break;
+            case "URL"_fnv1a32:          field = FIELD_URL; break;
+            case "URLPath"_fnv1a32:      field = FIELD_URLPATH; break;
+            case "Maintainer"_fnv1a32:   field = FIELD_MAINTAINER; break;
+            case "LastModified"_fnv1a32: field = FIELD_LASTMODIFIED; break;
+            case "OutOfDate"_fnv1a32:    field = FIELD_OUTOFDATE; break;
+            case "Popularity"_fnv1a32:   field = FIELD_POPULARITY; break;
+            case "NumVotes"_fnv1a32:     field = FIELD_NUMVOTES; break;
+            case "License"_fnv1a32:      field = FIELD_LICENSE; break;
+            case "Depends"_fnv1a32:      field = FIELD_DEPENDS; break;
+            case "MakeDepends"_fnv1a32:  field = FIELD_MAKEDEPENDS; break;
+            case "Provides"_fnv1a32:     field = FIELD_PROVIDES; break;
+            default:                     field = FIELD_NONE;
+        }
+        return true;
+    }
+
+    bool String(const char* str, rapidjson::SizeType length, bool)
+    {
+        if (depth == 2)
+        {
+            switch (field)
+            {
+                case FIELD_NAME:        pkg.name.assign(str, length); break;
+                case FIELD_VERSION:     pkg.version.assign(str, length); break;
+                case FIELD_DESCRIPTION: pkg.desc.assign(str, length); break;
+                case FIELD_URL:         pkg.url.assign(str, length); break;
+                case FIELD_URLPATH:     pkg.url_path.assign(str, length); break;
+                case FIELD_MAINTAINER:  pkg.maintainer.assign(str, length); break;
+                default:                break;
+            }
+            field = FIELD_NONE;
+        }
+        else if (depth == 3)
+        {
+            switch (field)
+            {
+                case FIELD_LICENSE:     pkg.licenses.emplace_back(str, length); break;
+                case FIELD_DEPENDS:     pkg.depends.emplace_back(str, length); break;
+                case FIELD_MAKEDEPENDS: pkg.makedepends.emplace_back(str, length); break;
+                case FIELD_PROVIDES:    pkg.provides.emplace_back(str, length); break;
+                default:                break;
+            }
+        }
+        return true;
+    }
+
+    bool Int(int i) { return this->Number(i); }
+    bool Uint(unsigned u) { return this->Number(u); }
+    bool Int64(int64_t i) { return this->Number(i); }
+    bool Uint64(uint64_t u) { return this->Number(u); }
+    bool Double(double d) { return this->Number(d); }
+
+    // bools and nulls (e.g an orphan's Maintainer) of fields we don't read
+    bool Default()
+    {
+        if (depth == 2)
+            field = FIELD_NONE;
+        return true;
+    }
+
+private:
+    enum
+    {
+        FIELD_NONE,
+        FIELD_NAME,
+        FIELD_VERSION,
+        FIELD_DESCRIPTION,
+        FIELD_URL,
+        FIELD_URLPATH,
+        FIELD_MAINTAINER,
+        FIELD_LASTMODIFIED,
+        FIELD_OUTOFDATE,
+        FIELD_POPULARITY,
+        FIELD_NUMVOTES,
+        FIELD_LICENSE,
+        FIELD_DEPENDS,
+        FIELD_MAKEDEPENDS,
+        FIELD_PROVIDES
+    } field = FIELD_NONE;
+
+    std::function<void(const AurMetaPkg_t&)> on_pkg;
+    AurMetaPkg_t                             pkg;
+    int                                      depth = 0;
+
+    template <typename T>
+    bool Number(const T value)
+    {
+        if (depth != 2)
+            return true;
+
+        switch (field)
+        {
+            case FIELD_LASTMODIFIED: pkg.last_modified = value; break;
+            case FIELD_OUTOFDATE:    pkg.outofdate = value; break;
+            case FIELD_POPULARITY:   pkg.popularity = value; break;
+            case FIELD_NUMVOTES:     pkg.votes = value; break;
+            default:                 break;
+        }
+        field = FIELD_NONE;
+        return true;
+    }
+};
+
+static std::shared_ptr<const TrigramIndex> aurSearchIndex(const AurMetaStore& store);
+
+/** Downloads the AUR metadata dump, to store it by column into cacheDir/packages-meta.idx
+ * (so lookups can be answered without the RPC, see fetch_pkgs_snapshot()), and to index what every package provides
+ * into cacheDir/provides.idx (so dependencies on virtual packages, e.g "java-runtime", can be resolved without searching the AUR).
+ * With config.indexedSearch, the names and descriptions also get a trigram index (cacheDir/aur.tri) for "-Ss",
+ * and the one of the sync DBs is brought up to date (see update_repos_search_index()).
+ * The dump is decompressed and parsed while it downloads, and only replaces them if all of it was read.
+ * Like packages.aur, it's a conditional request: if the dump didn't change, nothing is downloaded.
+ * @return true if both are up to date
+ */
+bool TaurBackend::update_aur_metadata()
+{
+    // the sync DBs may have been refreshed by pacman itself since
+    if (config.indexedSearch)
+        this->update_repos_search_index();
 
-#include "config.hpp"
-#include "util.hpp"
+    if (config.offline)
+    {
+        log_println(ERROR, _("Can't refresh the AUR metadata while offline"));
+        return false;
+    }
+
+    const path& index_path      = config.cacheDir / "provides.idx";
+    const path& store_path      = config.cacheDir / "packages-meta.idx";
+    const path& validators_path = config.cacheDir / "packages-meta.validators";
+    cpr::Header headers;
+
+    if (std::filesystem::exists(index_path) && std::filesystem::exists(store_path))
+        headers = readValidators(validators_path);
+
+    AurProvidesBuilder provides;
+    AurMetaBuilder     store;
+    size_t             pkgs_read = 0;
+    AurMetaHandler     handler([&](const AurMetaPkg_t& pkg) {
+        pkgs_read++;
+        store.add(pkg);
+        for (const std::string& provide : pkg.provides)
+            provides.add(pkg.name, provide);
+    });
+
+    // the parser runs on its own thread, fed by the decompressor, so it doesn't hold the whole dump in memory.
+    // when it falls behind, the download waits for it
+    RpcChunkStream         stream;
+    std::atomic<bool>      parsing = true;
+    rapidjson::ParseResult result;
+    std::thread            parser([&]() {
+        rapidjson::Reader reader;
+        result  = reader.Parse(stream, handler);
+        parsing = false;
+        stream.close();
+    });
+
+    GzipDecoder decoder([&](const std::string_view data) {
+        stream.push_wait(data);
+        return parsing.load();
+    });
+
+    log_println(INFO, _("Refreshing the AUR metadata"));
+    const cpr::Response& r =
+        this->http_get(this->aur_url() + "/packages-meta-ext-v1.json.gz", headers, [&](const std::string_view data) { return decoder.write(data); });
+    const bool complete = decoder.finish();
+
+    stream.finish();
+    parser.join();
+
+    if (r.status_code == 304)
+    {
+        log_println(DEBUG, "{} is up to date", store_path.string());
+        std::error_code err;
+        std::filesystem::last_write_time(store_path, std::filesystem::file_time_type::clock::now(), err);
+        return true;
+    }
+
+    if (r.status_code != 200)
+    {
+        log_println(ERROR, _("Failed to download {} with status code: {}"), r.url.str(), r.status_code);
+        return false;
+    }
+
+    if (!complete || result.IsError() || r.error.code != cpr::ErrorCode::OK)
+    {
+        log_println(ERROR, _("Failed to download {}: {}"), r.url.str(),
+                    r.error.message.empty() ? _("corrupted or incomplete data") : r.error.message);
+        return false;
+    }
+
+    if (!store.write(store_path, std::time(nullptr)) || !provides.write(index_path))
+        return false;
+
+    reload_aur_meta_store();
+    reload_aur_provides_index();
+    if (config.indexedSearch)
+        aurSearchIndex(*aur_meta_store());
+    writeValidators(validators_path, r);
+    log_println(INFO, _("Stored the metadata of {} AUR packages"), pkgs_read);
+    return true;
+}
+
+/** Performs AUR RPC requests, decoding the packages of each response while it downloads.
+ * Responses go through the on-disk cache (cacheDir/rpc): fresh entries are parsed without touching the network.
+ * With config.rpcStaleWhileRevalidate, expired search entries younger than config.rpcMaxStale are used right away too,
+ * and refreshed in the background. Info entries never are: they decide what gets upgraded, so they can't lag behind.
+ * Everything else is requested concurrently and written to the cache as it arrives.
+ * @param urls the RPC urls to request
+ * @param ttl how many seconds a cached response stays fresh, 0 disables the cache
+ * @param returnGit whether the aur_url of the packages should be a .git url
+ * @param fields the pkg_fields to decode, the others are left empty
+ * @param stop cancels the requests that are still running
+ * @return the results, in the same order as urls
+ */
+std::vector<RpcResult_t> TaurBackend::rpc_get(std::vector<std::string> const& urls, const int ttl, const bool returnGit, const int fields,
+                                              std::stop_token stop)
+{
+    std::vector<RpcResult_t> out(urls.size());
+    std::vector<std::string> stale_urls;
+    std::vector<size_t>      fetch_indices;
+
+    const bool        useCache    = ttl > 0 && !config.refreshRpc;
+    const bool        preferCache = useCache && (config.offline || this->rpc_budget_low());
+    const std::time_t now         = std::time(nullptr);
+    const std::string base_url    = this->aur_url();
+
+    for (size_t i = 0; i < urls.size(); i++)
+    {
+        std::ifstream file;
+        std::time_t   mtime;
+        if (useCache && openRpcCache(normalizeRpcUrl(urls[i]), file, mtime))
+        {
+            const std::time_t age        = now - mtime;
+            const bool        allowStale = config.rpcStaleWhileRevalidate && isRpcSearch(urls[i]);
+            if (preferCache || age <= ttl || (allowStale && age <= config.rpcMaxStale))
+            {
+                rapidjson::IStreamWrapper stream(file);
+                rapidjson::Reader         reader;
+                RpcPkgHandler<TaurPkg_t>  handler(returnGit, fields, base_url);
+
+                if (!reader.Parse(stream, handler).IsError())
+                {
+                    log_println(DEBUG, "rpc cache hit ({}s old{}): {}", age, age > ttl ? ", stale" : "", urls[i]);
+                    out[i] = { .pkgs        = std::move(handler.pkgs),
+                               .type        = std::move(handler.type),
+                               .error       = std::move(handler.error),
+                               .status_code = 200,
+                               .cached      = true };
+
+                    if (age > ttl && !preferCache)
+                        stale_urls.push_back(urls[i]);
+                    continue;
+                }
+            }
+        }
+
+        fetch_indices.push_back(i);
+    }
+
+    if (!fetch_indices.empty())
+    {
+        // where the body of a transfer goes, made once it starts arriving and closed once the transfer is done,
+        // so only the transfers in flight hold a parser thread and a cache file
+        struct rpc_sink_t
+        {
+            std::unique_ptr<RpcStreamParser> parser;
+            std::ofstream                    file;
+            std::string                      key, tmp_path;
+            bool                             parsed = false, done = false;
+        };
+
+        std::vector<HttpResponse_t> transfers(fetch_indices.size());
+        std::vector<rpc_sink_t>     sinks(fetch_indices.size());
+
+        const auto& finish_sink = [&](const size_t j) {
+            rpc_sink_t& sink = sinks[j];
+            if (sink.done)
+                return;
+
+            sink.done   = true;
+            sink.parsed = sink.parser && sink.parser->finish();
+            if (sink.file.is_open())
+            {
+                sink.file.close();
+                publishRpcCache(sink.key, sink.tmp_path,
+                                sink.parsed && isRpcResponseCacheable(transfers[j].status_code, sink.parser->handler.type));
+            }
+        };
+
+        for (size_t j = 0; j < fetch_indices.size(); j++)
+        {
+            transfers[j].url     = urls[fetch_indices[j]];
+            transfers[j].stop    = stop;
+            transfers[j].on_data = [&, j](const std::string_view data) {
+                rpc_sink_t& sink = sinks[j];
+                if (!sink.parser)
+                {
+                    sink.parser = std::make_unique<RpcStreamParser>(returnGit, fields, base_url);
+                    if (ttl > 0)
+                    {
+                        sink.key      = normalizeRpcUrl(urls[fetch_indices[j]]);
+                        sink.tmp_path = getRpcCacheTmpPath(sink.key);
+                        sink.file.open(sink.tmp_path, std::ios::trunc);
+                        sink.file << sink.key << '\n';
+                    }
+                }
+
+                if (sink.file.is_open())
+                    sink.file.write(data.data(), data.size());
+                sink.parser->push(data);
+            };
+            transfers[j].ready   = [&, j]() { return !sinks[j].parser || sinks[j].parser->ready(); };
+            transfers[j].on_done = [&, j]() { finish_sink(j); };
+        }
+
+        this->http_perform_multi(transfers);
+
+        for (size_t j = 0; j < fetch_indices.size(); j++)
+        {
+            finish_sink(j);
+
+            RpcResult_t& result = out[fetch_indices[j]];
+            rpc_sink_t&  sink   = sinks[j];
+
+            // a transfer that broke off (e.g cancelled) after its headers came in has no usable status
+            result.status_code = transfers[j].error.empty() ? transfers[j].status_code : 0;
+            result.elapsed     = transfers[j].elapsed;
+            result.error       = transfers[j].error;
+
+            if (sink.parsed)
+            {
+                result.pkgs = std::move(sink.parser->handler.pkgs);
+                result.type = std::move(sink.parser->handler.type);
+                if (!sink.parser->handler.error.empty())
+                    result.error = std::move(sink.parser->handler.error);
+            }
+        }
+    }
+
+    // done here instead of in the handler, libalpm isn't thread safe.
+    std::lock_guard<std::mutex> lock(this->alpm_mutex);
+    alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+    for (RpcResult_t& result : out)
+        for (TaurPkg_t& pkg : result.pkgs)
+            if (fields & PKG_FIELD_INSTALLED)
+                pkg.installed = alpm_db_get_pkg(localdb, pkg.name.c_str()) != nullptr;
+
+    if (!stale_urls.empty())
+    {
+        std::lock_guard<std::mutex> lock(this->rpc_refreshes_mutex);
+        this->rpc_refreshes.push_back(std::async(std::launch::async, [this, stale_urls = std::move(stale_urls)]() {
+            for (const HttpResponse_t& resp : this->http_get_multi(stale_urls))
+                writeRpcCache(normalizeRpcUrl(resp.url), resp);
+        }));
+    }
 
-TaurBackend::TaurBackend(Config& cfg) : config(cfg) {}
+    return out;
+}
+
+/** Performs a single AUR RPC request like rpc_get(), but parses the response in place:
+ * the packages are views into the response buffer, which the returned RpcView_t owns,
+ * so decoding doesn't allocate per string.
+ * @param url the RPC url to request
+ * @param ttl how many seconds a cached response stays fresh, 0 disables the cache
+ * @return the response and its packages
+ */
+/** Parses the RPC response in out.buffer in place, the packages become views into it.
+ * @return whether it parsed, out is left without packages if not
+ */
+bool parseRpcView(RpcView_t& out)
+{
+    rapidjson::InsituStringStream stream(out.buffer->data());
+    rapidjson::Reader             reader;
+    RpcPkgHandler<TaurPkgView_t>  handler;
+
+    if (reader.Parse<rapidjson::kParseInsituFlag>(stream, handler).IsError())
+        return false;
+
+    // moving a vector keeps its buffer, so the spans stay valid in out.lists
+    handler.bindLists();
+    out.pkgs  = std::move(handler.pkgs);
+    out.lists = std::move(handler.lists);
+    out.type  = std::move(handler.type);
+    if (!handler.error.empty())
+        out.error = std::move(handler.error);
+
+    return true;
+}
+
+RpcView_t TaurBackend::rpc_get_view(const std::string& url, const int ttl)
+{
+    RpcView_t         out{ .buffer = std::make_unique<std::string>() };
+    const std::string key = normalizeRpcUrl(url);
+
+    std::ifstream file;
+    std::time_t   mtime;
+    if (ttl > 0 && !config.refreshRpc && openRpcCache(key, file, mtime))
+    {
+        const bool        preferCache = config.offline || this->rpc_budget_low();
+        const std::time_t age         = std::time(nullptr) - mtime;
+        if (preferCache || age <= ttl || (config.rpcStaleWhileRevalidate && age <= config.rpcMaxStale))
+        {
+            out.buffer->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            out.status_code = 200;
+            out.cached      = true;
+            log_println(DEBUG, "rpc cache hit ({}s old{}): {}", age, age > ttl ? ", stale" : "", url);
+
+            if (age > ttl && !preferCache)
+            {
+                std::lock_guard<std::mutex> lock(this->rpc_refreshes_mutex);
+                this->rpc_refreshes.push_back(std::async(std::launch::async, [this, url, key]() {
+                    writeRpcCache(key, this->http_get_multi({ url }).front());
+                }));
+            }
+        }
+    }
+
+    if (!out.cached)
+    {
+        HttpResponse_t resp = std::move(this->http_get_multi({ url }).front());
+        if (ttl > 0)
+            writeRpcCache(key, resp);
+
+        out.status_code = resp.status_code;
+        out.error       = std::move(resp.error);
+        *out.buffer     = std::move(resp.text);
+    }
+
+    if (!parseRpcView(out))
+        return out;
+
+    // strings parsed in place are null terminated in the buffer
+    std::lock_guard<std::mutex> lock(this->alpm_mutex);
+    alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+    for (TaurPkgView_t& pkg : out.pkgs)
+        pkg.installed = alpm_db_get_pkg(localdb, pkg.name.data()) != nullptr;
+
+    return out;
+}
 
 bool TaurBackend::download_git(const std::string_view url, const path& out_path)
 {
+    if (config.offline)
+    {
+        if (std::filesystem::exists(path(out_path) / ".git"))
+        {
+            log_println(WARN, _("Offline, building {} from the clone that's already there"), out_path.string());
+            return true;
+        }
+
+        log_println(ERROR, _("Offline, and {} was never cloned"), url);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->fresh_clones_mutex);
+        if (this->fresh_clones.erase(out_path.string()) > 0)
+        {
+            log_println(DEBUG, "{} was just cloned, not pulling it", out_path.string());
+            return true;
+        }
+    }
+
     if (std::filesystem::exists(path(out_path) / ".git"))
     {
         return taur_exec({ config.git.c_str(), "-C", out_path, "pull", "--autostash", "--rebase", "--force" });
@@ -25,16 +1666,103 @@ bool TaurBackend::download_git(const std::string_view url, const path& out_path)
     }
 }
 
+/** Clones a git repo in the background, unless it's there already.
+ * It's cloned next to out_path first and moved there once complete,
+ * so a clone that failed or got interrupted is never mistaken for a good one.
+ * download_git() doesn't pull a repo this cloned, it's as fresh as it gets.
+ * @param url the url of the repo
+ * @param out_path where the repo should end up
+ * @param stop cancels the clone, git is killed and the partial clone removed
+ * @return a future to whether the repo is there now
+ */
+std::future<bool> TaurBackend::prefetch_git(const std::string& url, const path& out_path, std::stop_token stop)
+{
+    return std::async(std::launch::async, [this, url, out_path, stop]() {
+        if (std::filesystem::exists(out_path) || config.offline)
+            return std::filesystem::exists(out_path);
+
+        const path& tmp_path = out_path.parent_path() / ("." + out_path.filename().string() + ".prefetch");
+
+        std::error_code err;
+        std::filesystem::remove_all(tmp_path, err);
+
+        // like taur_exec(), but it doesn't block, so that it can be killed
+        const auto& clone = [&]() {
+            const pid_t pid = fork();
+            if (pid < 0)
+                return false;
+
+            if (pid == 0)
+            {
+                execlp(config.git.c_str(), config.git.c_str(), "clone", "--quiet", url.c_str(), tmp_path.c_str(), nullptr);
+                _exit(127);
+            }
+
+            int status;
+            while (waitpid(pid, &status, WNOHANG) == 0)
+            {
+                if (stop.stop_requested())
+                {
+                    log_println(DEBUG, "cancelling the prefetch of {}", url);
+                    kill(pid, SIGTERM);
+                    waitpid(pid, &status, 0);
+                    return false;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        };
+
+        if (!clone())
+        {
+            std::filesystem::remove_all(tmp_path, err);
+            return false;
+        }
+
+        std::filesystem::rename(tmp_path, out_path, err);
+        if (err)
+        {
+            std::filesystem::remove_all(tmp_path, err);
+            return std::filesystem::exists(out_path);
+        }
+
+        std::lock_guard<std::mutex> lock(this->fresh_clones_mutex);
+        this->fresh_clones.insert(out_path.string());
+        return true;
+    });
+}
+
 bool TaurBackend::download_tar(const std::string_view url, const path& out_path)
 {
     const std::string& out_path_str = out_path.string();
+    if (config.offline)
+    {
+        // the tarball extracts to out_path without ".tar.gz"
+        const path& extracted_path = out_path_str.substr(0, out_path_str.length() - ".tar.gz"_len);
+        if (std::filesystem::exists(extracted_path / "PKGBUILD"))
+        {
+            log_println(WARN, _("Offline, building {} from the sources that are already there"), extracted_path.string());
+            return true;
+        }
+
+        log_println(ERROR, _("Offline, and {} was never downloaded"), url);
+        return false;
+    }
+
     std::ofstream out(out_path_str.substr(0, out_path_str.length() - "tar.gz"_len));
     if (!out.is_open())
         return false;
 
     cpr::Session session;
-    session.SetUrl(cpr::Url(url));
+    this->setup_session(session, url);
+
+    net_transfers++;
     const cpr::Response& r = session.Download(out);
+    this->count_connection(session.GetCurlHolder()->handle);
+    net_transfers--;
+
+    exitIfInterrupted();
 
     if (r.status_code != 200)
         return false;
@@ -63,127 +1791,493 @@ bool TaurBackend::download_pkg(const std::string_view url, const path out_path)
     return false;
 }
 
-static std::string getUrl(const rapidjson::Value& pkgJson, const bool returnGit = false)
+static TaurPkg_t pkgFromStore(const AurMetaStore& store, const size_t i, const std::string_view base_url, const bool returnGit)
+{
+    TaurPkg_t pkg{ .name          = std::string(store.name(i)),
+                   .version       = std::string(store.version(i)),
+                   .url           = std::string(store.url(i)),
+                   .desc          = std::string(store.desc(i)),
+                   .maintainer    = std::string(store.maintainer(i)),
+                   .last_modified = store.last_modified(i),
+                   .outofdate     = store.outofdate(i),
+                   .popularity    = store.popularity(i),
+                   .votes         = store.votes(i),
+                   .licenses      = { store.licenses(i).begin(), store.licenses(i).end() },
+                   .makedepends   = { store.makedepends(i).begin(), store.makedepends(i).end() },
+                   .depends       = { store.depends(i).begin(), store.depends(i).end() } };
+
+    pkg.aur_url = returnGit ? AUR_URL_GIT(base_url, pkg.name) : fmt::format("{}{}", base_url, store.url_path(i));
+    pkg.totaldepends.reserve(pkg.depends.size() + pkg.makedepends.size());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.depends.begin(), pkg.depends.end());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.makedepends.begin(), pkg.makedepends.end());
+
+    return pkg;
+}
+
+// e.g "3 days", for how old something is
+static std::string formatAge(const std::time_t seconds)
+{
+    if (seconds < 2 * 3600)
+        return fmt::format(fmt::runtime(_("{} minutes")), seconds / 60);
+    if (seconds < 2 * 86400)
+        return fmt::format(fmt::runtime(_("{} hours")), seconds / 3600);
+    return fmt::format(fmt::runtime(_("{} days")), seconds / 86400);
+}
+
+/** Reads a package out of the .SRCINFO of a repo cloned in cacheDir, for offline lookups of packages the
+ * stored metadata doesn't have. Only what .SRCINFO knows gets filled in (no votes, popularity etc.).
+ * @param clone_path the repo
+ * @param name the package, a split package only gets the fields of its own section and of pkgbase
+ */
+static std::optional<TaurPkg_t> pkgFromSrcinfo(const path& clone_path, const std::string_view name, const std::string_view base_url,
+                                               const bool returnGit)
+{
+    std::ifstream file(clone_path / ".SRCINFO");
+    if (!file.is_open())
+        return {};
+
+    TaurPkg_t   pkg{ .name = std::string(name) };
+    std::string pkgver, pkgrel, epoch;
+    bool        in_base = false, in_pkg = false, found = false;
+    // which lists the section of the package redefines, they replace the ones of pkgbase
+    bool        own_licenses = false, own_depends = false, own_makedepends = false;
+
+    const auto add_to = [&in_pkg](std::vector<std::string>& list, bool& own, const std::string_view value) {
+        if (in_pkg && !own)
+        {
+            list.clear();
+            own = true;
+        }
+        list.emplace_back(value);
+    };
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        const size_t sep = line.find(" = ");
+        if (sep == line.npos)
+            continue;
+
+        // the fields of a section are indented
+        const size_t           key_pos = std::min(line.find_first_not_of(" \t"), sep);
+        const std::string_view key     = std::string_view(line).substr(key_pos, sep - key_pos);
+        const std::string_view value   = std::string_view(line).substr(sep + " = "_len);
+        if (key == "pkgbase")
+        {
+            in_base = true;
+            in_pkg  = false;
+            continue;
+        }
+        if (key == "pkgname")
+        {
+            in_base = false;
+            in_pkg  = value == name;
+            found   = found || in_pkg;
+            continue;
+        }
+        if (!in_base && !in_pkg)
+            continue;
+
+        switch (fnv1a32::hash(key))
+        {
+            case "pkgver"_fnv1a32:      pkgver = value; break;
+            case "pkgrel"_fnv1a32:      pkgrel = value; break;
+            case "epoch"_fnv1a32:       epoch = value; break;
+            case "pkgdesc"_fnv1a32:     pkg.desc = value; break;
+            case "url"_fnv1a32:         pkg.url = value; break;
+            case "license"_fnv1a32:     add_to(pkg.licenses, own_licenses, value); break;
+            case "depends"_fnv1a32:     add_to(pkg.depends, own_depends, value); break;
+            case "makedepends"_fnv1a32: add_to(pkg.makedepends, own_makedepends, value); break;
+        }
+    }
+
+    if (!found || pkgver.empty())
+        return {};
+
+    pkg.version = fmt::format("{}{}-{}", epoch.empty() ? "" : epoch + ":", pkgver, pkgrel);
+    pkg.aur_url = returnGit ? AUR_URL_GIT(base_url, pkg.name) : fmt::format("{}/cgit/aur.git/snapshot/{}.tar.gz", base_url, pkg.name);
+    pkg.totaldepends.reserve(pkg.depends.size() + pkg.makedepends.size());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.depends.begin(), pkg.depends.end());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.makedepends.begin(), pkg.makedepends.end());
+
+    return pkg;
+}
+
+/** The AUR metadata stored by update_aur_metadata(), if lookups can be answered from it:
+ * online while it's not older than config.metadataMaxAge, offline whatever its age.
+ * Offline, how old it is gets reported the first time.
+ * @return the store, or nullptr
+ */
+std::shared_ptr<const AurMetaStore> TaurBackend::usable_meta_store()
+{
+    if (!config.offline && (config.metadataMaxAge <= 0 || config.refreshRpc))
+        return nullptr;
+
+    std::shared_ptr<const AurMetaStore> store = aur_meta_store();
+
+    // a 304 on refresh only touches the file, so that's when the metadata was last known to be current
+    struct stat store_stat;
+    const bool  valid = store->valid() && stat((config.cacheDir / "packages-meta.idx").c_str(), &store_stat) == 0;
+    const std::time_t age = valid ? std::time(nullptr) - store_stat.st_mtim.tv_sec : 0;
+
+    if (config.offline)
+    {
+        std::call_once(this->offline_reported, [&]() {
+            if (!valid)
+            {
+                log_println(WARN, _("Offline, and no AUR metadata is stored: only the repos cloned in {} can be used. "
+                                    "Run \"taur --refresh-metadata\" while online"), config.cacheDir.string());
+                return;
+            }
+
+            std::string timestr = std::ctime(&store_stat.st_mtim.tv_sec);
+            timestr.pop_back();
+            log_println(age > config.metadataMaxAge ? WARN : INFO, _("Offline, using the AUR metadata of {} ({} old)"), timestr, formatAge(age));
+        });
+
+        return valid ? store : nullptr;
+    }
+
+    if (!valid || age > config.metadataMaxAge)
+        return nullptr;
+
+    return store;
+}
+
+/** Looks up packages in the AUR metadata stored by update_aur_metadata(), see usable_meta_store().
+ * Offline, the packages it doesn't have are also read from the repos already cloned in cacheDir.
+ * @param pkgs the names of the packages to look up, the ones that were found are removed from it.
+ *             The others weren't in the AUR when the metadata was downloaded, so they have to be looked up with the RPC
+ * @param returnGit whether the aur_url of the packages should be a .git url
+ * @return the packages that were found
+ */
+std::vector<TaurPkg_t> TaurBackend::fetch_pkgs_snapshot(std::vector<std::string>& pkgs, const bool returnGit)
+{
+    if (pkgs.empty())
+        return {};
+
+    const std::shared_ptr<const AurMetaStore>& store = this->usable_meta_store();
+    if (!store && !config.offline)
+        return {};
+
+    std::vector<TaurPkg_t> out;
+    const std::string&     base_url = this->aur_url();
+    std::erase_if(pkgs, [&](const std::string& name) {
+        if (store)
+        {
+            if (const std::optional<size_t>& i = store->find(name))
+            {
+                out.push_back(pkgFromStore(*store, *i, base_url, returnGit));
+                return true;
+            }
+        }
+
+        if (config.offline)
+        {
+            if (std::optional<TaurPkg_t> pkg = pkgFromSrcinfo(config.cacheDir / name, name, base_url, returnGit))
+            {
+                log_println(DEBUG, "offline, read {} from its clone", name);
+                out.push_back(std::move(*pkg));
+                return true;
+            }
+        }
+
+        return false;
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(this->alpm_mutex);
+        alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+        for (TaurPkg_t& pkg : out)
+            pkg.installed = alpm_db_get_pkg(localdb, pkg.name.c_str()) != nullptr;
+    }
+
+    log_println(DEBUG, "{} packages found in the stored AUR metadata, {} left to look up", out.size(), pkgs.size());
+    return out;
+}
+
+/** Looks up packages through the lookups made during this run.
+ * Packages that were already looked up (or are being looked up right now, by another thread)
+ * aren't requested again, only the others are passed to fetch.
+ * @param pkgs the names of the packages to look up
+ * @param returnGit whether the aur_url of the packages should be a .git url
+ * @param fetch looks up the packages that are new to this run, and adds the ones it couldn't get an answer for
+ * (the request failed) to its second argument. Only the packages the AUR answered for are remembered as found or not
+ * @return the packages that were found, in the same order as pkgs
+ */
+std::vector<TaurPkg_t> TaurBackend::lookup_memoized(std::vector<std::string> const& pkgs, const bool returnGit,
+                                                    const std::function<std::vector<TaurPkg_t>(std::vector<std::string> const&, std::vector<std::string>&)>& fetch)
+{
+    std::vector<std::shared_future<std::optional<TaurPkg_t>>> lookups;
+    std::vector<std::promise<std::optional<TaurPkg_t>>>       promises;
+    std::vector<std::string>                                  toFetch;
+    lookups.reserve(pkgs.size());
+
+    {
+        std::lock_guard<std::mutex> lock(this->pkg_lookups_mutex);
+        for (const std::string& pkg : pkgs)
+        {
+            const auto& [it, inserted] = this->pkg_lookups.try_emplace(fmt::format("{}:{}", returnGit, pkg));
+            if (inserted)
+            {
+                it->second = promises.emplace_back().get_future().share();
+                toFetch.push_back(pkg);
+            }
+            else
+                this->lookups_saved++;
+
+            lookups.push_back(it->second);
+        }
+    }
+
+    if (!toFetch.empty())
+    {
+        // the lookups that didn't get an answer are dropped, so that a later call tries again
+        const auto& forget = [&](std::vector<std::string> const& names) {
+            std::lock_guard<std::mutex> lock(this->pkg_lookups_mutex);
+            for (const std::string& pkg : names)
+                this->pkg_lookups.erase(fmt::format("{}:{}", returnGit, pkg));
+        };
+
+        std::vector<TaurPkg_t>   fetched;
+        std::vector<std::string> failed;
+        try
+        {
+            std::vector<std::string> missing = toFetch;
+            fetched = this->fetch_pkgs_snapshot(missing, returnGit);
+            if (!missing.empty())
+                std::ranges::move(fetch(missing, failed), std::back_inserter(fetched));
+        }
+        catch (...)
+        {
+            forget(toFetch);
+            for (auto& promise : promises)
+                promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        if (!failed.empty())
+        {
+            log_println(DEBUG, "{} lookups failed, they won't be remembered", failed.size());
+            forget(failed);
+        }
+
+        for (size_t i = 0; i < toFetch.size(); i++)
+        {
+            const auto& found = std::find_if(fetched.begin(), fetched.end(),
+                                             [&](const TaurPkg_t& pkg) { return pkg.name == toFetch[i]; });
+            // the ones that failed are reported as not found to whoever is waiting on them right now
+            if (found != fetched.end())
+                promises[i].set_value(std::move(*found));
+            else
+                promises[i].set_value({});
+        }
+    }
+
+    std::vector<TaurPkg_t> out;
+    out.reserve(pkgs.size());
+    for (const auto& lookup : lookups)
+        if (const std::optional<TaurPkg_t>& pkg = lookup.get())
+            out.push_back(*pkg);
+
+    return out;
+}
+
+std::optional<TaurPkg_t> TaurBackend::fetch_pkg(const std::string_view pkg, const bool returnGit)
 {
-    if (returnGit)
-        return fmt::format("https://aur.archlinux.org/{}.git", pkgJson["Name"].GetString());
+    std::vector<TaurPkg_t> found = this->lookup_memoized({ std::string(pkg) }, returnGit, [&](std::vector<std::string> const& pkgs, std::vector<std::string>& failed) {
+        const std::string& urlStr = this->aur_url() + "/rpc/v5/info/" + cpr::util::urlEncode(pkgs.front());
+
+        RpcResult_t result = std::move(this->rpc_get({ urlStr }, config.rpcInfoTTL, returnGit).front());
+        if (result.status_code != 200)
+        {
+            failed = pkgs;
+            return std::vector<TaurPkg_t>();
+        }
+
+        return std::move(result.pkgs);
+    });
+
+    if (found.empty())
+        return {};
 
-    // URLPath starts with a / 
-    return fmt::format("https://aur.archlinux.org{}", pkgJson["URLPath"].GetString());
+    return std::move(found.front());
 }
 
-static TaurPkg_t parsePkg(const rapidjson::Value& pkgJson, const bool returnGit = false)
+/** Looks up multiple packages at once, every package gets its own info request,
+ * and they're all in flight concurrently (up to config.maxConcurrentRequests).
+ * @param pkgs the names of the packages to look up
+ * @param returnGit whether the aur_url of the packages should be a .git url
+ * @return a future to the packages that were found, in the same order as pkgs
+ */
+std::future<std::vector<TaurPkg_t>> TaurBackend::fetch_pkgs_async(std::vector<std::string> pkgs, const bool returnGit)
 {
-    std::vector<std::string> makedepends, depends, totaldepends, licenses;
+    return std::async(std::launch::async, [this, pkgs = std::move(pkgs), returnGit]() {
+        return this->lookup_memoized(pkgs, returnGit, [&](std::vector<std::string> const& toFetch, std::vector<std::string>& failed) {
+            // a request per package is faster, but way more expensive
+            if (this->rpc_budget_low())
+                return this->fetch_pkgs_chunked(toFetch, returnGit, PKG_FIELDS_ALL, &failed);
 
-    // yes, it will get depends and makedepends even one doesn't have it
-    if (pkgJson.HasMember("Depends") && pkgJson["Depends"].IsArray())
-    {
-        const rapidjson::Value& dependsArray = pkgJson["Depends"].GetArray();
+            std::vector<std::string> urls;
+            urls.reserve(toFetch.size());
 
-        depends.reserve(dependsArray.Size());
+            const std::string& base_url = this->aur_url();
+            for (const std::string& pkg : toFetch)
+                urls.push_back(base_url + "/rpc/v5/info/" + cpr::util::urlEncode(pkg));
 
-        for (size_t i = 0; i < dependsArray.Size(); i++)
-            depends.push_back(dependsArray[i].GetString());
+            std::vector<TaurPkg_t> out;
+            out.reserve(toFetch.size());
 
-        totaldepends.insert(totaldepends.end(), depends.begin(), depends.end());
-        // for (size_t i = 0; i < makeDependsArray.Size(); i++) {
-        //     // make sure it isn't in the depends list
-        //     if (std::find(totaldepends.begin(), totaldepends.end(), makeDependsArray[i].GetString()) !=
-        //     totaldepends.end())
-        //         continue;
-        //     totaldepends.push_back(makeDependsArray[i].GetString());
-        // }
-    }
+            std::vector<RpcResult_t> results = this->rpc_get(urls, config.rpcInfoTTL, returnGit);
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                if (results[i].status_code != 200)
+                {
+                    log_println(DEBUG, "info request {} failed: {} {}", urls[i], results[i].status_code, results[i].error);
+                    failed.push_back(toFetch[i]);
+                    continue;
+                }
 
-    if (pkgJson.HasMember("MakeDepends") && pkgJson["MakeDepends"].IsArray())
-    {
-        const rapidjson::Value& makeDependsArray = pkgJson["MakeDepends"].GetArray();
+                std::move(results[i].pkgs.begin(), results[i].pkgs.end(), std::back_inserter(out));
+            }
 
-        makedepends.reserve(makeDependsArray.Size());
+            return out;
+        });
+    });
+}
 
-        for (size_t i = 0; i < makeDependsArray.Size(); ++i)
-            makedepends.push_back(makeDependsArray[i].GetString());
+// sorts pkgs in the order their names have in names
+static void orderLike(std::vector<TaurPkg_t>& pkgs, std::vector<std::string> const& names)
+{
+    std::unordered_map<std::string_view, size_t> index;
+    index.reserve(names.size());
+    for (size_t i = 0; i < names.size(); i++)
+        index.try_emplace(names[i], i);
+
+    std::ranges::stable_sort(pkgs, std::less<>(), [&](const TaurPkg_t& pkg) {
+        const auto& it = index.find(pkg.name);
+        return it != index.end() ? it->second : names.size();
+    });
+}
 
-        totaldepends.insert(totaldepends.end(), makedepends.begin(), makedepends.end());
-    }
+/** Splits info lookups into urls that aren't longer than maxLen, keeping the order of pkgs.
+ * A name that doesn't fit in a url on its own still gets one, as short as it can be.
+ * @param base_url the url the arguments get appended to, e.g "https://aur.archlinux.org/rpc/v5/info?"
+ * @param pkgs the names of the packages to look up
+ * @param maxLen the length urls should stay within
+ * @param chunkSizes set to how many names each url has
+ * @return the urls
+ */
+std::vector<std::string> splitInfoUrls(const std::string_view base_url, std::vector<std::string> const& pkgs, const size_t maxLen,
+                                       std::vector<size_t>& chunkSizes)
+{
+    std::vector<std::string> urls;
+    chunkSizes.clear();
+    if (pkgs.empty())
+        return urls;
 
-    if (pkgJson.HasMember("License") && pkgJson["License"].IsArray())
+    std::string urlStr(base_url);
+    size_t      chunkSize = 0;
+
+    for (const std::string& pkg : pkgs)
     {
-        const rapidjson::Value& licensesArray = pkgJson["License"].GetArray();
+        const std::string& arg = "arg%5B%5D=" + cpr::util::urlEncode(pkg);
 
-        licenses.reserve(licensesArray.Size());
+        // + 1 for the '&'
+        if (chunkSize > 0 && urlStr.length() + arg.length() + 1 > maxLen)
+        {
+            urls.push_back(std::move(urlStr));
+            chunkSizes.push_back(chunkSize);
 
-        for (size_t i = 0; i < licensesArray.Size(); ++i)
-            licenses.push_back(licensesArray[i].GetString());
-    }
+            urlStr    = base_url;
+            chunkSize = 0;
+        }
 
-    TaurPkg_t out = {
-        .name          = pkgJson["Name"].GetString(),
-        .version       = pkgJson["Version"].GetString(),
-        .aur_url       = getUrl(pkgJson, returnGit),
-        .desc          = pkgJson["Description"].IsString() ? pkgJson["Description"].GetString() : "",
-        .maintainer    = pkgJson["Maintainer"].IsString()
-                             ? pkgJson["Maintainer"].GetString()
-                             : "\1",  // it's impossible that the maintainer name is a binary char
-        .last_modified = pkgJson["LastModified"].GetInt64(),
-        .outofdate     = pkgJson["OutOfDate"].IsInt64() ? pkgJson["OutOfDate"].GetInt64() : 0,
-        .popularity    = pkgJson["Popularity"].GetFloat(),
-        .votes         = pkgJson["NumVotes"].GetFloat(),
-        .licenses      = licenses,
-        .makedepends   = makedepends,
-        .depends       = depends,
-        .totaldepends  = totaldepends,
-        .installed     = alpm_db_get_pkg(alpm_get_localdb(config->handle), pkgJson["Name"].GetString()) != nullptr,
-    };
+        if (chunkSize > 0)
+            urlStr += '&';
 
-    return out;
+        urlStr += arg;
+        chunkSize++;
+    }
+
+    urls.push_back(std::move(urlStr));
+    chunkSizes.push_back(chunkSize);
+    return urls;
 }
 
-std::optional<TaurPkg_t> TaurBackend::fetch_pkg(const std::string_view pkg, const bool returnGit)
+/** Looks up multiple packages using the info RPC.
+ * The names are split into chunks that fit in config.maxUrlLength, and the chunks are requested in parallel.
+ * Full lookups go through the lookups of this run, see lookup_memoized().
+ * @param pkgs the names of the packages to look up
+ * @param returnGit whether the aur_url of the packages should be a .git url
+ * @param fields the pkg_fields the caller needs, the others are not decoded and left empty
+ * @param stop cancels the lookups, the cancelled ones count as failed and aren't remembered
+ * @return the packages that were found, in the same order as pkgs
+ */
+std::vector<TaurPkg_t> TaurBackend::fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit, const int fields,
+                                               std::stop_token stop)
 {
-    const std::string& urlStr = "https://aur.archlinux.org/rpc/v5/info/" + cpr::util::urlEncode(pkg.data());
-
-    const cpr::Response& resp = cpr::Get(cpr::Url(urlStr));
-
-    if (resp.status_code != 200)
-        return {};
-
-    rapidjson::Document json;
-    json.Parse(resp.text.c_str());
-
-    if (json["resultcount"].GetInt() > 0)
-        return parsePkg(json["results"][0], returnGit);
+    if (fields != PKG_FIELDS_ALL)
+    {
+        std::vector<std::string> missing = pkgs;
+        std::vector<TaurPkg_t>   out     = this->fetch_pkgs_snapshot(missing, returnGit);
+        std::ranges::move(this->fetch_pkgs_chunked(missing, returnGit, fields, nullptr, stop), std::back_inserter(out));
+        orderLike(out, pkgs);
+        return out;
+    }
 
-    return {};
+    return this->lookup_memoized(pkgs, returnGit, [&](std::vector<std::string> const& toFetch, std::vector<std::string>& failed) {
+        return this->fetch_pkgs_chunked(toFetch, returnGit, fields, &failed, stop);
+    });
 }
 
-std::vector<TaurPkg_t> TaurBackend::fetch_pkgs(std::vector<std::string> const& pkgs, const bool returnGit)
+/** Looks up packages with info requests of as many names as config.maxUrlLength allows, see splitInfoUrls().
+ * @param failed if not null, gets the names of the chunks that failed
+ * @param stop cancels the requests
+ * @return the packages that were found, in the same order as pkgs
+ */
+std::vector<TaurPkg_t> TaurBackend::fetch_pkgs_chunked(std::vector<std::string> const& pkgs, const bool returnGit, const int fields,
+                                                       std::vector<std::string>* failed, std::stop_token stop)
 {
     if (pkgs.empty())
         return {};
 
-    std::string urlStr = "https://aur.archlinux.org/rpc/v5/info?arg%5B%5D=" + pkgs[0];
-    urlStr.reserve(pkgs.size());
+    std::vector<size_t>             chunkSizes;
+    const std::vector<std::string>& urls = splitInfoUrls(this->aur_url() + "/rpc/v5/info?", pkgs, config.maxUrlLength, chunkSizes);
 
-    for (size_t i = 1; i < pkgs.size(); i++)
-        urlStr += ("&arg%5B%5D=" + pkgs[i]);
+    std::vector<RpcResult_t> results = this->rpc_get(urls, config.rpcInfoTTL, returnGit, fields, stop);
+
+    std::vector<TaurPkg_t> out;
+    out.reserve(pkgs.size());
 
-    log_println(DEBUG, "info url = {}", urlStr);
+    // the index in pkgs of the first name of chunk i
+    size_t chunkBegin = 0;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        RpcResult_t& result = results[i];
 
-    const cpr::Response& resp = cpr::Get(cpr::Url(urlStr));
+        log_println(DEBUG, "info chunk {}/{}: {} packages, url length {}, took {:.3f}s", i + 1, results.size(),
+                    chunkSizes[i], urls[i].length(), result.elapsed);
 
-    if (resp.status_code != 200)
-        return {};
+        if (result.status_code != 200)
+        {
+            if (stop.stop_requested())
+                log_println(DEBUG, "info chunk {} cancelled", i + 1);
+            else
+                log_println(ERROR, _("Failed to look up {} packages: {} {}"), chunkSizes[i], result.status_code, result.error);
+            if (failed)
+                failed->insert(failed->end(), pkgs.begin() + chunkBegin, pkgs.begin() + chunkBegin + chunkSizes[i]);
+            chunkBegin += chunkSizes[i];
+            continue;
+        }
 
-    rapidjson::Document json;
-    json.Parse(resp.text.c_str());
+        chunkBegin += chunkSizes[i];
 
-    std::vector<TaurPkg_t> out;
-    out.reserve(json["resultcount"].GetInt());
-    for (int i = 0; i < json["resultcount"].GetInt(); i++)
-        out.push_back(parsePkg(json["results"][i], returnGit));
+        std::move(result.pkgs.begin(), result.pkgs.end(), std::back_inserter(out));
+    }
 
+    // the AUR answers in its own order
+    orderLike(out, pkgs);
     return out;
 }
 
@@ -298,29 +2392,114 @@ bool TaurBackend::build_pkg(const std::string_view pkg_name, const std::string_v
     return true;
 }
 
-// I don't know but I feel this is shitty, atleast it works great
-bool TaurBackend::handle_aur_depends(const TaurPkg_t& pkg, const path& out_path, std::vector<TaurPkg_t> const& localPkgs, const bool useGit)
+/** Picks the AUR packages that satisfy a list of dependencies.
+ * A dependency is looked up in the AUR package names first, then, unless it's satisfied by an installed package
+ * or by a package of the repos, in what the AUR packages provide (see update_aur_metadata()).
+ * Of the AUR providers, an installed one is picked, else the user picks when there's more than one.
+ * @param depends the dependencies, optionally with version constraints (e.g "foo>=1.0")
+ * @param index the AUR package names
+ * @param useGit whether the providers the user picks from should be looked up with .git urls
+ * @return the names of the AUR packages to fetch, without duplicates
+ */
+std::vector<std::string> TaurBackend::resolve_aur_depends(std::vector<std::string> const& depends, const AurIndex& index, const bool useGit)
 {
-    log_println(DEBUG, "pkg.name = {}", pkg.name);
-    log_println(DEBUG, "pkg.totaldepends = {}", pkg.totaldepends);
-    const std::vector<std::string>& aur_list = load_aur_list();
+    const std::shared_ptr<const AurProvidesIndex>& provides = aur_provides_index();
 
-    for (size_t i = 0; i < pkg.totaldepends.size(); i++)
+    std::vector<std::string> out;
+    for (const std::string& depend : depends)
     {
-        std::string_view pkg_depend;
-
-        if (std::binary_search(aur_list.begin(), aur_list.end(), pkg.totaldepends.at(i)))
-            pkg_depend = pkg.totaldepends.at(i);
+        const std::string_view name = std::string_view(depend).substr(0, depend.find_first_of("<>="));
+        if (index.contains(name))
+        {
+            if (std::find(out.begin(), out.end(), name) == out.end())
+                out.emplace_back(name);
+            continue;
+        }
 
-        if (pkg_depend.empty())
+        if (!provides->valid())
             continue;
 
-        const std::optional<TaurPkg_t>& oDepend = this->fetch_pkg(pkg_depend, useGit);
-        if (!oDepend)
+        // an installed package or a package of the repos already takes care of it
+        {
+            std::lock_guard<std::mutex> lock(this->alpm_mutex);
+            if (alpm_find_satisfier(alpm_db_get_pkgcache(alpm_get_localdb(config.handle)), depend.c_str()) ||
+                alpm_find_dbs_satisfier(config.handle, config.repos, depend.c_str()))
+                continue;
+        }
+
+        const std::vector<std::string_view>& providers = provides->providers(depend);
+        if (providers.empty())
             continue;
 
-        const TaurPkg_t& depend = oDepend.value();
+        // an installed AUR provider that doesn't satisfy the version constraint, gets upgraded rather than replaced
+        std::vector<std::string> picked;
+        {
+            std::lock_guard<std::mutex> lock(this->alpm_mutex);
+            alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+            for (const std::string_view provider : providers)
+            {
+                if (alpm_db_get_pkg(localdb, std::string(provider).c_str()))
+                {
+                    picked.emplace_back(provider);
+                    break;
+                }
+            }
+        }
+
+        if (picked.empty() && providers.size() == 1)
+            picked.emplace_back(providers.front());
+        else if (picked.empty())
+        {
+            log_println(INFO, _("{} is provided by {} packages in the AUR"), depend, providers.size());
+
+            std::vector<TaurPkg_t> candidates = this->fetch_pkgs({ providers.begin(), providers.end() }, useGit);
+            if (candidates.empty())
+                picked.emplace_back(providers.front());
+            else if (config.noconfirm)
+            {
+                // the most popular one, there's no one to ask
+                picked.push_back(std::max_element(candidates.begin(), candidates.end(), [](const TaurPkg_t& a, const TaurPkg_t& b) {
+                                     return a.popularity < b.popularity;
+                                 })->name);
+            }
+            else
+            {
+                const std::optional<std::vector<TaurPkg_t>>& selected = askUserForPkg(candidates, *this, useGit);
+                if (selected)
+                    for (const TaurPkg_t& pkg : *selected)
+                        picked.push_back(pkg.name);
+            }
+        }
+
+        for (const std::string& provider : picked)
+        {
+            log_println(INFO, _("{} is provided by {} in the AUR"), depend, provider);
+            if (std::find(out.begin(), out.end(), provider) == out.end())
+                out.push_back(provider);
+        }
+    }
+
+    return out;
+}
+
+// I don't know but I feel this is shitty, atleast it works great
+
+bool TaurBackend::handle_aur_depends(const TaurPkg_t& pkg, const path& out_path, std::vector<TaurPkg_t> const& localPkgs, const bool useGit)
+{
+    log_println(DEBUG, "pkg.name = {}", pkg.name);
+    log_println(DEBUG, "pkg.totaldepends = {}", pkg.totaldepends);
+    const std::shared_ptr<const AurIndex>& index = aur_index();
+    if (!index->valid())
+        die(_("Failed to open {}"), (config.cacheDir / "packages.aur").c_str());
+
+    const std::vector<std::string>& aur_depends = this->resolve_aur_depends(pkg.totaldepends, *index, useGit);
+
+    // look them all up at once, so we only wait for the slowest request.
+    const std::vector<TaurPkg_t>& depends = this->fetch_pkgs_async(aur_depends, useGit).get();
+    exitIfInterrupted();
 
+    for (const TaurPkg_t& depend : depends)
+    {
         log_println(DEBUG, "depend = {} -- depend.totaldepends = {}", depend.name, depend.totaldepends);
 
         bool alreadyExists = false;
@@ -339,22 +2518,13 @@ bool TaurBackend::handle_aur_depends(const TaurPkg_t& pkg, const path& out_path,
             continue;
         }
 
-        for (size_t i = 0; i < depend.totaldepends.size(); i++)
-        {
-            std::string_view sub_pkg_depend;
-
-            if (std::binary_search(aur_list.begin(), aur_list.end(), depend.totaldepends.at(i)))
-                sub_pkg_depend = depend.totaldepends.at(i);
-
-            if (sub_pkg_depend.empty())
-                continue;
-
-            const std::optional<TaurPkg_t>& oSubDepend = this->fetch_pkg(sub_pkg_depend, useGit);
-            if (!oDepend)
-                continue;
+        const std::vector<std::string>& aur_sub_depends = this->resolve_aur_depends(depend.totaldepends, *index, useGit);
 
-            const TaurPkg_t& subDepend = oSubDepend.value();
+        const std::vector<TaurPkg_t>& subDepends = this->fetch_pkgs_async(aur_sub_depends, useGit).get();
+        exitIfInterrupted();
 
+        for (const TaurPkg_t& subDepend : subDepends)
+        {
             alreadyExists = false;
             for (size_t j = 0; (j < localPkgs.size() && !alreadyExists); j++)
             {
@@ -462,7 +2632,8 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
     for (const TaurPkg_t& pkg : localPkgs)
         pkgNames.push_back(pkg.name);
 
-    const std::vector<TaurPkg_t>& onlinePkgs = this->fetch_pkgs(pkgNames, useGit);
+    // only decode what's needed to compare versions, the depends etc. are fetched later for the upgrade targets
+    const std::vector<TaurPkg_t>& onlinePkgs = this->fetch_pkgs(pkgNames, useGit, PKG_FIELDS_UPGRADE_CHECK);
 
     int updatedPkgs        = 0;
     int attemptedDownloads = 0;
@@ -506,6 +2677,24 @@ bool TaurBackend::update_all_aur_pkgs(const path& cacheDir, const bool useGit)
     if (!askUserYorN(true, PROMPT_YN_PROCEED_UPGRADE))
         return false;
 
+    std::vector<std::string> targetNames;
+    targetNames.reserve(potentialUpgradeTargets.size());
+    for (const auto& potentialUpgrade : potentialUpgradeTargets)
+        targetNames.push_back(std::get<0>(potentialUpgrade).name);
+
+    // now get everything about the packages we're actually going to build
+    for (TaurPkg_t& fullPkg : this->fetch_pkgs(targetNames, useGit))
+    {
+        for (auto& potentialUpgrade : potentialUpgradeTargets)
+        {
+            if (std::get<0>(potentialUpgrade).name == fullPkg.name)
+            {
+                std::get<0>(potentialUpgrade) = std::move(fullPkg);
+                break;
+            }
+        }
+    }
+
     for (const auto& potentialUpgrade : potentialUpgradeTargets)
     {
         // size_t pkgIndex;
@@ -671,33 +2860,264 @@ std::vector<TaurPkg_t> TaurBackend::get_all_local_pkgs(const bool aurOnly)
     std::vector<TaurPkg_t> out;
     out.reserve(pkgs.size());
 
+    const std::string& base_url = this->aur_url();
     for (alpm_pkg_t* pkg : pkgs)
     {
         out.push_back({ .name    = alpm_pkg_get_name(pkg),
                         .version = alpm_pkg_get_version(pkg),
-                        .aur_url = "https://aur.archlinux.org/" + cpr::util::urlEncode(alpm_pkg_get_name(pkg)) + ".git",
+                        .aur_url = AUR_URL_GIT(base_url, cpr::util::urlEncode(alpm_pkg_get_name(pkg))),
                         .installed = true });
     }
 
     return out;
 }
 
-// They are different because we found that fetching each AUR pkg is very time consuming, so we store the name and look
-// it up later.
-std::vector<TaurPkg_t> TaurBackend::getPkgFromJson(const rapidjson::Document& doc, const bool useGit)
+// whether needle is in haystack, ignoring the case of ASCII letters like the AUR search does
+static bool containsIgnoreCase(const std::string_view haystack, const std::string_view needle)
+{
+    return std::search(haystack.begin(), haystack.end(), needle.begin(), needle.end(), [](const unsigned char a, const unsigned char b) {
+               return std::tolower(a) == std::tolower(b);
+           }) != haystack.end();
+}
+
+/** Searches the stored AUR metadata.
+ * It matches the same field as the RPC search would with the same searchBy,
+ * fields that aren't stored (optdepends, checkdepends) fall back to names and descriptions.
+ * @param index the trigram index of store, if any. Only the packages it returns for query are checked then
+ * @return the rows of the matching packages
+ */
+static std::vector<size_t> searchStore(const AurMetaStore& store, const std::string_view query, const std::string_view by, const TrigramIndex* index)
+{
+    const auto list_contains = [](const AurMetaList& list, const std::string_view name) {
+        for (const std::string_view depend : list)
+            if (depend.substr(0, depend.find_first_of("<>=")) == name)
+                return true;
+        return false;
+    };
+
+    const auto matches = [&](const size_t i) {
+        switch (fnv1a32::hash(by))
+        {
+            case "name"_fnv1a32:        return containsIgnoreCase(store.name(i), query);
+            case "depends"_fnv1a32:     return list_contains(store.depends(i), query);
+            case "makedepends"_fnv1a32: return list_contains(store.makedepends(i), query);
+            default:                    return containsIgnoreCase(store.name(i), query) || containsIgnoreCase(store.desc(i), query);
+        }
+    };
+
+    // the index has the names and descriptions
+    const bool byText = by != "depends" && by != "makedepends";
+
+    std::vector<size_t> rows;
+    if (const std::optional<std::vector<uint32_t>>& candidates = index && byText ? index->candidates(query) : std::nullopt)
+    {
+        log_println(DEBUG, "trigram index: {} candidates for {}", candidates->size(), query);
+        for (const uint32_t i : *candidates)
+            if (matches(i))
+                rows.push_back(i);
+        return rows;
+    }
+
+    for (size_t i = 0; i < store.size(); i++)
+        if (matches(i))
+            rows.push_back(i);
+
+    return rows;
+}
+
+/** The trigram index of the stored AUR metadata, cacheDir/aur.tri, rebuilt if it's not of store.
+ * @return the index, or nullptr if it couldn't be built
+ */
+static std::shared_ptr<const TrigramIndex> aurSearchIndex(const AurMetaStore& store)
+{
+    // searches run concurrently, only one of them builds it
+    static std::mutex           build_mutex;
+    std::lock_guard<std::mutex> lock(build_mutex);
+
+    const std::shared_ptr<const TrigramIndex>& index = search_index("aur.tri");
+    if (index->valid() && index->stamp() == static_cast<uint64_t>(store.snapshot()) && index->docs() == store.size())
+        return index;
+
+    log_println(DEBUG, "building the trigram index of the AUR metadata");
+    TrigramIndexBuilder builder;
+    for (size_t i = 0; i < store.size(); i++)
+        builder.add({}, { store.name(i), store.desc(i) });
+
+    if (!builder.write(config->cacheDir / "aur.tri", store.snapshot()))
+        return nullptr;
+
+    reload_search_index("aur.tri");
+    return search_index("aur.tri");
+}
+
+// changes whenever a sync DB gets refreshed, or pacman.conf lists other ones
+static uint64_t reposStamp()
+{
+    const path& sync_dir = path(alpm_option_get_dbpath(config->handle)) / "sync";
+
+    std::string files;
+    for (alpm_list_t* db = config->repos; db; db = alpm_list_next(db))
+    {
+        const char* name = alpm_db_get_name(static_cast<alpm_db_t*>(db->data));
+        struct stat db_stat;
+        if (stat((sync_dir / fmt::format("{}.db", name)).c_str(), &db_stat) != 0)
+            return 0;
+
+        files += fmt::format("{}:{}.{}:{};", name, db_stat.st_mtim.tv_sec, db_stat.st_mtim.tv_nsec, db_stat.st_size);
+    }
+
+    // what gets indexed, so that an index of older taur versions isn't used
+    files += "name,desc,provide names,groups";
+
+    return fnv1a64::hash(files);
+}
+
+/** Calls f with every string alpm_db_search() matches a query against:
+ * the name, the description, the names of the provides (without their version) and the groups of pkg.
+ * It stops at the first call that returns true.
+ * @return whether a call returned true
+ */
+template <typename F>
+static bool forEachSearchedText(alpm_pkg_t* pkg, F&& f)
+{
+    if (f(alpm_pkg_get_name(pkg)))
+        return true;
+
+    if (const char* desc = alpm_pkg_get_desc(pkg); desc && f(desc))
+        return true;
+
+    for (alpm_list_t* provide = alpm_pkg_get_provides(pkg); provide; provide = alpm_list_next(provide))
+    {
+        if (f(static_cast<alpm_depend_t*>(provide->data)->name))
+            return true;
+    }
+
+    for (alpm_list_t* group = alpm_pkg_get_groups(pkg); group; group = alpm_list_next(group))
+        if (f(static_cast<const char*>(group->data)))
+            return true;
+
+    return false;
+}
+
+/** Rebuilds the trigram index of the sync DBs, cacheDir/repos.tri, unless it matches them already.
+ * Call it once they got refreshed (e.g "-Sy"), searches only use the index while it matches them, see searchReposIndex().
+ * The DBs are read through a handle of their own, config.handle may still have the ones from before the refresh loaded.
+ * @return true if the index is up to date
+ */
+bool TaurBackend::update_repos_search_index()
+{
+    const uint64_t stamp = reposStamp();
+    if (stamp == 0)
+        return false;
+
+    const std::shared_ptr<const TrigramIndex>& current = search_index("repos.tri");
+    if (current->valid() && current->stamp() == stamp)
+        return true;
+
+    alpm_errno_t   err;
+    alpm_handle_t* handle = alpm_initialize(config.getConfigValue<std::string>("pacman.RootDir", "/").c_str(),
+                                            alpm_option_get_dbpath(config.handle), &err);
+    if (!handle)
+    {
+        log_println(ERROR, _("Failed to get an alpm handle! Error: {}"), alpm_strerror(err));
+        return false;
+    }
+
+    for (alpm_list_t* db = config.repos; db; db = alpm_list_next(db))
+        alpm_register_syncdb(handle, alpm_db_get_name(static_cast<alpm_db_t*>(db->data)), ALPM_SIG_USE_DEFAULT);
+
+    log_println(DEBUG, "building the trigram index of the sync DBs");
+    TrigramIndexBuilder builder;
+    for (alpm_list_t* db = alpm_get_syncdbs(handle); db; db = alpm_list_next(db))
+    {
+        const std::string_view db_name = alpm_db_get_name(static_cast<alpm_db_t*>(db->data));
+        for (alpm_list_t* pkg = alpm_db_get_pkgcache(static_cast<alpm_db_t*>(db->data)); pkg; pkg = alpm_list_next(pkg))
+        {
+            std::vector<std::string> texts;
+            forEachSearchedText(static_cast<alpm_pkg_t*>(pkg->data), [&](const char* text) {
+                texts.emplace_back(text);
+                return false;
+            });
+
+            const std::vector<std::string_view> views(texts.begin(), texts.end());
+            builder.add(fmt::format("{}/{}", db_name, alpm_pkg_get_name(static_cast<alpm_pkg_t*>(pkg->data))), views);
+        }
+    }
+    alpm_release(handle);
+
+    if (!builder.write(config.cacheDir / "repos.tri", stamp))
+        return false;
+
+    reload_search_index("repos.tri");
+    return true;
+}
+
+/** Searches the sync DBs through their trigram index, cacheDir/repos.tri, see TaurBackend::update_repos_search_index().
+ * Like alpm_db_search(), it matches the names, descriptions, provides and groups, ignoring the case.
+ * Call it with alpm_mutex held.
+ * @return the packages that have query in one of those, or nothing if alpm_db_search() has to do it
+ *         (a query shorter than a trigram, a regex, or no index that matches the sync DBs)
+ */
+static std::optional<std::vector<alpm_pkg_t*>> searchReposIndex(const std::string_view query)
 {
-    int resultcount = doc["resultcount"].GetInt();
+    // alpm_db_search() takes regexes, the index only finds plain substrings
+    if (query.size() < 3 || query.find_first_of(".^$*+?()[]{}|\\") != query.npos)
+        return {};
+
+    const std::shared_ptr<const TrigramIndex>& index = search_index("repos.tri");
+    if (!index->valid() || index->stamp() != reposStamp())
+    {
+        log_println(DEBUG, "the trigram index of the sync DBs is missing or out of date, scanning them");
+        return {};
+    }
+
+    const std::optional<std::vector<uint32_t>>& candidates = index->candidates(query);
+    if (!candidates)
+        return {};
 
-    std::vector<TaurPkg_t> out(resultcount);
+    std::vector<alpm_pkg_t*> out;
+    for (const uint32_t doc : *candidates)
+    {
+        // keys are "db/name"
+        const std::string_view key = index->doc_key(doc);
+        const size_t           sep = key.find('/');
+        for (alpm_list_t* db = config->repos; db; db = alpm_list_next(db))
+        {
+            if (alpm_db_get_name(static_cast<alpm_db_t*>(db->data)) != key.substr(0, sep))
+                continue;
 
-    for (int i = 0; i < resultcount; i++)
-        out[i] = parsePkg(doc["results"][i], useGit);
+            alpm_pkg_t* pkg = alpm_db_get_pkg(static_cast<alpm_db_t*>(db->data), std::string(key.substr(sep + 1)).c_str());
+            if (pkg && forEachSearchedText(pkg, [&](const char* text) { return containsIgnoreCase(text, query); }))
+                out.push_back(pkg);
+            break;
+        }
+    }
 
     return out;
 }
 
+/** Searches the stored AUR metadata instead of asking the AUR: offline, and with config.indexedSearch
+ * while it's fresh (see usable_meta_store()). With config.indexedSearch, through its trigram index.
+ * @param store set to the store the rows are of
+ * @return the rows of the matching packages, or nothing if the AUR has to be asked
+ */
+std::optional<std::vector<size_t>> TaurBackend::search_snapshot(const std::string_view query, std::shared_ptr<const AurMetaStore>& store)
+{
+    if (!config.offline && !config.indexedSearch)
+        return {};
+
+    store = this->usable_meta_store();
+    if (!store)
+        return config.offline ? std::optional(std::vector<size_t>()) : std::nullopt;
+
+    const std::shared_ptr<const TrigramIndex>& index = config.indexedSearch ? aurSearchIndex(*store) : nullptr;
+    return searchStore(*store, query, config.getConfigValue<std::string>("searchBy", "name-desc"), index.get());
+}
+
 std::vector<TaurPkg_t> TaurBackend::search_pac(const std::string_view query)
 {
+    std::lock_guard<std::mutex> lock(this->alpm_mutex);
+
     // we search for the package name and print only the name, not the description
     alpm_list_t* syncdbs = config.repos;
     alpm_db_t*   localdb = alpm_get_localdb(config.handle);
@@ -705,6 +3125,21 @@ std::vector<TaurPkg_t> TaurBackend::search_pac(const std::string_view query)
     alpm_list_smart_pointer packages(nullptr, alpm_list_free);
     alpm_list_smart_pointer query_regex(alpm_list_add(nullptr, (void*)query.data()), alpm_list_free);
 
+    std::optional<std::vector<alpm_pkg_t*>> indexed;
+    if (config.indexedSearch)
+        indexed = searchReposIndex(query);
+
+    if (indexed)
+    {
+        for (alpm_pkg_t* pkg : *indexed)
+        {
+            alpm_list_t* packages_get = packages.get();
+            (void)packages.release();
+            packages = make_list_smart_pointer(alpm_list_add(packages_get, pkg));
+        }
+        syncdbs = nullptr;
+    }
+
     for (; syncdbs; syncdbs = alpm_list_next(syncdbs))
     {
         alpm_list_t* ret = nullptr;
@@ -737,49 +3172,200 @@ std::vector<TaurPkg_t> TaurBackend::search_pac(const std::string_view query)
     return out;
 }
 
-// Returns an optional that is empty if an error occurs
-// status will be set to -1 in the case of an error as well.
-std::vector<TaurPkg_t> TaurBackend::search(const std::string_view query, const bool useGit, const bool aurOnly, const bool checkExactMatch)
+/** Searches the AUR like search(), but returns views into the parsed response instead of copies.
+ * Only AUR packages are returned, and they live as long as the returned RpcView_t.
+ * @param query the search term
+ */
+RpcView_t TaurBackend::search_view(const std::string_view query)
 {
     if (query.empty())
         return {};
 
-    // link to AUR API. Took search pattern from yay
-    const cpr::Url& url = fmt::format("https://aur.archlinux.org/rpc?arg%5B%5D={}&by={}&type=search&v=5", cpr::util::urlEncode(query.data()), config.getConfigValue<std::string>("searchBy", "name-desc"));
-    log_println(DEBUG, "url search = {}", url.str());
+    std::shared_ptr<const AurMetaStore> store;
+    if (const std::optional<std::vector<size_t>>& rows = this->search_snapshot(query, store))
+    {
+        RpcView_t                                             out{ .owner = store, .type = "search" };
+        std::vector<std::array<std::pair<size_t, size_t>, 3>> list_ranges;
+        for (const size_t i : *rows)
+        {
+            out.pkgs.push_back({ .name          = store->name(i),
+                                 .version       = store->version(i),
+                                 .url           = store->url(i),
+                                 .url_path      = store->url_path(i),
+                                 .desc          = store->desc(i),
+                                 .maintainer    = store->maintainer(i),
+                                 .last_modified = store->last_modified(i),
+                                 .outofdate     = store->outofdate(i),
+                                 .popularity    = store->popularity(i),
+                                 .votes         = store->votes(i) });
+
+            auto& ranges = list_ranges.emplace_back();
+            for (size_t l = 0; const AurMetaList& list : { store->depends(i), store->makedepends(i), store->licenses(i) })
+            {
+                ranges[l++] = { out.lists.size(), list.size() };
+                out.lists.insert(out.lists.end(), list.begin(), list.end());
+            }
+        }
+
+        // the lists won't grow anymore, point the spans into them
+        for (size_t i = 0; i < out.pkgs.size(); i++)
+        {
+            out.pkgs[i].depends     = { out.lists.data() + list_ranges[i][0].first, list_ranges[i][0].second };
+            out.pkgs[i].makedepends = { out.lists.data() + list_ranges[i][1].first, list_ranges[i][1].second };
+            out.pkgs[i].licenses    = { out.lists.data() + list_ranges[i][2].first, list_ranges[i][2].second };
+        }
+
+        std::lock_guard<std::mutex> lock(this->alpm_mutex);
+        alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+        for (TaurPkgView_t& pkg : out.pkgs)
+            pkg.installed = alpm_db_get_pkg(localdb, std::string(pkg.name).c_str()) != nullptr;
+
+        out.status_code = 200;
+        return out;
+    }
+
+    const std::string& url = fmt::format("{}/rpc?arg%5B%5D={}&by={}&type=search&v=5", this->aur_url(), cpr::util::urlEncode(query.data()), config.getConfigValue<std::string>("searchBy", "name-desc"));
+    log_println(DEBUG, "url search = {}", url);
+
+    RpcView_t result = this->rpc_get_view(url, config.rpcSearchTTL);
+    if (result.type == "error")
+        log_println(ERROR, "AUR Search error: {}", result.error);
+
+    return result;
+}
 
-    const cpr::Response r = cpr::Get(url);
-    const std::string_view raw_text_response = r.text;
+/** Searches the AUR (see search_view()) and the sync DBs at once, for "-Ss".
+ * Both get ranked on their own (see rankSearchResults()) and merged, up to config.searchLimit results.
+ * @param query the search term
+ * @param aurOnly whether to skip the sync DBs
+ */
+SearchResults_t TaurBackend::search_ranked(const std::string_view query, const bool aurOnly)
+{
+    std::future<std::vector<TaurPkg_t>> pacSearch;
+    if (!aurOnly)
+        pacSearch = std::async(std::launch::async, [this, query]() { return this->search_pac(query); });
+
+    SearchResults_t out{ .aur = this->search_view(query) };
+    if (pacSearch.valid())
+        out.repos = pacSearch.get();
+
+    rankSearchResults(out.aur.pkgs, query, config.searchLimit);
+    rankSearchResults(out.repos, query, config.searchLimit);
+
+    // both lists are ranked already, so merge them and stop at the limit
+    const PkgRanking_t ranking{ query };
+    const size_t       total = out.aur.pkgs.size() + out.repos.size();
+    const size_t       limit = config.searchLimit > 0 ? std::min<size_t>(config.searchLimit, total) : total;
+    out.ranked.reserve(limit);
+    for (size_t aur = 0, pac = 0; aur + pac < limit;)
+    {
+        if (pac >= out.repos.size() || (aur < out.aur.pkgs.size() && !ranking(out.repos[pac], out.aur.pkgs[aur])))
+            out.ranked.emplace_back(true, aur++);
+        else
+            out.ranked.emplace_back(false, pac++);
+    }
+
+    return out;
+}
 
-    rapidjson::Document json_response;
-    json_response.Parse(raw_text_response.data());
+// copies a package out of an RpcView_t, the same way the RPC handler fills a TaurPkg_t
+static TaurPkg_t pkgFromView(const TaurPkgView_t& view, const std::string_view base_url, const bool returnGit)
+{
+    TaurPkg_t pkg{ .name          = std::string(view.name),
+                   .version       = std::string(view.version),
+                   .url           = std::string(view.url),
+                   .desc          = std::string(view.desc),
+                   .maintainer    = std::string(view.maintainer),
+                   .last_modified = view.last_modified,
+                   .outofdate     = view.outofdate,
+                   .popularity    = view.popularity,
+                   .votes         = view.votes,
+                   .licenses      = { view.licenses.begin(), view.licenses.end() },
+                   .makedepends   = { view.makedepends.begin(), view.makedepends.end() },
+                   .depends       = { view.depends.begin(), view.depends.end() },
+                   .installed     = view.installed };
+
+    pkg.aur_url = returnGit ? AUR_URL_GIT(base_url, pkg.name) : fmt::format("{}{}", base_url, view.url_path);
+    pkg.totaldepends.reserve(pkg.depends.size() + pkg.makedepends.size());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.depends.begin(), pkg.depends.end());
+    pkg.totaldepends.insert(pkg.totaldepends.end(), pkg.makedepends.begin(), pkg.makedepends.end());
+
+    return pkg;
+}
+
+// Returns an optional that is empty if an error occurs
+// status will be set to -1 in the case of an error as well.
+// Without checkExactMatch, the results are the ones of search_ranked(), copied.
+std::vector<TaurPkg_t> TaurBackend::search(const std::string_view query, const bool useGit, const bool aurOnly, const bool checkExactMatch)
+{
+    if (query.empty())
+        return {};
 
-    // clang-format off
-    const std::vector<TaurPkg_t>& aurPkgs = (json_response["resultcount"].GetInt64() > 0) ? 
-                                            this->getPkgFromJson(json_response, useGit) : std::vector<TaurPkg_t>();
+    if (!checkExactMatch)
+    {
+        SearchResults_t        results  = this->search_ranked(query, aurOnly);
+        const std::string&     base_url = this->aur_url();
+        std::vector<TaurPkg_t> out;
+        out.reserve(results.ranked.size());
+        for (const auto& [aur, i] : results.ranked)
+            out.push_back(aur ? pkgFromView(results.aur.pkgs[i], base_url, useGit) : std::move(results.repos[i]));
+
+        return out;
+    }
 
-    const std::vector<TaurPkg_t>& pacPkgs = (!aurOnly) ? this->search_pac(query)        : std::vector<TaurPkg_t>();
+    // we'd only return the exact match anyway, and one info lookup is way cheaper
+    // than a search that returns every package with the query somewhere in its name or description.
+    if (aur_index()->contains(query))
+    {
+        if (std::optional<TaurPkg_t> pkg = this->fetch_pkg(query, useGit))
+        {
+            log_println(DEBUG, "{} is an AUR package, skipped the search", query);
+            return { std::move(*pkg) };
+        }
+    }
 
-    if (std::string_view(json_response["type"].GetString(), json_response["type"].GetStringLength()) == "error")
-        log_println(ERROR, "AUR Search error: {}", json_response["error"].GetString());
+    // the sync DBs are searched while the AUR answers
+    std::future<std::vector<TaurPkg_t>> pacSearch;
+    if (!aurOnly)
+        pacSearch = std::async(std::launch::async, [this, query]() { return this->search_pac(query); });
 
-    const size_t& allPkgsSize = aurPkgs.size() + pacPkgs.size();
+    // link to AUR API. Took search pattern from yay
+    const cpr::Url& url = fmt::format("{}/rpc?arg%5B%5D={}&by={}&type=search&v=5", this->aur_url(), cpr::util::urlEncode(query.data()), config.getConfigValue<std::string>("searchBy", "name-desc"));
+    log_println(DEBUG, "url search = {}", url.str());
 
-    std::vector<TaurPkg_t> combined;
+    std::vector<TaurPkg_t>              combined;
+    std::shared_ptr<const AurMetaStore> store;
+    if (const std::optional<std::vector<size_t>>& rows = this->search_snapshot(query, store))
+    {
+        const std::string& base_url = this->aur_url();
+        for (const size_t i : *rows)
+            combined.push_back(pkgFromStore(*store, i, base_url, useGit));
+
+        std::lock_guard<std::mutex> lock(this->alpm_mutex);
+        alpm_db_t*                  localdb = alpm_get_localdb(config.handle);
+        for (TaurPkg_t& pkg : combined)
+            pkg.installed = alpm_db_get_pkg(localdb, pkg.name.c_str()) != nullptr;
+    }
+    else
+    {
+        RpcResult_t result = std::move(this->rpc_get({ url.str() }, config.rpcSearchTTL, useGit).front());
 
-    combined.reserve(allPkgsSize);
+        if (result.type == "error")
+            log_println(ERROR, "AUR Search error: {}", result.error);
 
-    if (!aurPkgs.empty())
-        combined.insert(combined.end(), aurPkgs.begin(), aurPkgs.end());
-    if (!pacPkgs.empty())
-        combined.insert(combined.end(), pacPkgs.begin(), pacPkgs.end());
+        combined = std::move(result.pkgs);
+    }
 
-    if (!checkExactMatch)  // caller doesn't want us to check for an exact match.
-        return combined;
+    if (pacSearch.valid())
+    {
+        std::vector<TaurPkg_t> pacPkgs = pacSearch.get();
+        combined.reserve(combined.size() + pacPkgs.size());
+        std::move(pacPkgs.begin(), pacPkgs.end(), std::back_inserter(combined));
+    }
 
     for (size_t i = 0; i < combined.size(); i++)
         if (combined[i].name == query)
-            return { combined[i] };  // return the exact match only.
+            return { std::move(combined[i]) };  // return the exact match only.
 
     return combined;
 }
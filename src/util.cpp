@@ -22,6 +22,7 @@
 #pragma GCC diagnostic ignored "-Wignored-attributes"
 
 #include "config.hpp"
+#include "index.hpp"
 #include "switch_fnv1a.hpp"
 #include "pacman.hpp"
 #include "taur.hpp"
@@ -145,9 +146,26 @@ void sanitizeStr(std::string& str)
 
 /** Print some text after hitting CTRL-C.
  * Used only in main() for signal()
+ * If there are network transfers running, they're cancelled instead, and exit once they stopped.
+ * Hitting CTRL-C again exits right away.
  */
 void interruptHandler(int)
-{ die(_("Caught CTRL-C, Exiting!")); }
+{
+    if (net_transfers > 0 && !net_interrupted.exchange(true))
+        return;
+
+    die(_("Caught CTRL-C, Exiting!"));
+}
+
+/** Exits if CTRL-C cancelled the network transfers, but only on the main thread.
+ * A worker (e.g a std::async lookup) just returns its cancelled transfers,
+ * exiting from there would run the static destructors while the main thread still uses them.
+ */
+void exitIfInterrupted()
+{
+    if (net_interrupted && std::this_thread::get_id() == main_thread_id)
+        die(_("Caught CTRL-C, Exiting!"));
+}
 
 // clang-format on
 /** Function to check if a package is from a synchronization database
@@ -610,7 +628,8 @@ fmt::text_style getColorFromDBName(const std::string_view db_name)
 }
 
 // Takes a pkg to show on search.
-void printPkgInfo(const TaurPkg_t& pkg, const std::string_view db_name)
+template <typename Pkg_t>
+static void printPkgInfoImpl(const Pkg_t& pkg, const std::string_view db_name)
 {
     fmt::print(getColorFromDBName(db_name), "{}/", db_name);
     fmt::print(BOLD, "{} ", pkg.name);
@@ -644,6 +663,12 @@ void printPkgInfo(const TaurPkg_t& pkg, const std::string_view db_name)
     fmt::println("    {}", pkg.desc);
 }
 
+void printPkgInfo(const TaurPkg_t& pkg, const std::string_view db_name)
+{ printPkgInfoImpl(pkg, db_name); }
+
+void printPkgInfo(const TaurPkgView_t& pkg, const std::string_view db_name)
+{ printPkgInfoImpl(pkg, db_name); }
+
 void printLocalFullPkgInfo(alpm_pkg_t* pkg)
 {
     /* make aligned titles once only */
@@ -795,35 +820,250 @@ bool util_db_search(alpm_db_t* db, alpm_list_t* needles, alpm_list_t** ret)
     return "";
 }*/
 
-std::vector<std::string> load_aur_list()
+GzipDecoder::~GzipDecoder()
+{
+    if (this->inflating)
+        inflateEnd(&this->stream);
+}
+
+/** Decodes the next chunk of the stream.
+ * @param data the chunk, as it arrived
+ * @return false if it's corrupted, or the output callback returned false
+ */
+bool GzipDecoder::write(const std::string_view data)
 {
-    const path&   file_path = config->cacheDir / "packages.aur";
-    std::ifstream infile(file_path);
-    if (!infile.good())
-        die(_("Failed to open {}"), file_path.c_str());
+    if (this->failed)
+        return false;
 
-    std::vector<std::string> aur_list;
-    std::string              pkg;
+    if (this->detected)
+        return this->consume(data);
 
-    while (std::getline(infile, pkg))
-        aur_list.push_back(pkg);
+    // the first 2 bytes tell if it's gzip
+    this->head.append(data);
+    if (this->head.size() < 2)
+        return true;
+
+    this->detected  = true;
+    this->inflating = static_cast<uint8_t>(this->head[0]) == 0x1f && static_cast<uint8_t>(this->head[1]) == 0x8b;
+    if (this->inflating && inflateInit2(&this->stream, 15 + 16) != Z_OK)
+    {
+        this->inflating = false;
+        this->failed    = true;
+        return false;
+    }
+
+    const std::string head = std::move(this->head);
+    return this->consume(head);
+}
+
+// @return false if the stream was corrupted or cut short
+bool GzipDecoder::finish()
+{
+    if (!this->detected && !this->head.empty() && !this->consume(this->head))
+        return false;
 
-    return aur_list;
+    if (this->inflating && !this->ended)
+        this->failed = true;
+
+    return !this->failed;
 }
 
-bool download_aur_cache(const path& file_path)
+bool GzipDecoder::consume(const std::string_view data)
+{
+    if (!this->inflating)
+    {
+        this->failed = !this->output(data);
+        return !this->failed;
+    }
+
+    char buf[65536];
+    this->stream.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    this->stream.avail_in = data.size();
+    do
+    {
+        // a gzip file can be multiple members back to back
+        if (this->ended && this->stream.avail_in > 0)
+        {
+            inflateReset(&this->stream);
+            this->ended = false;
+        }
+
+        this->stream.next_out  = reinterpret_cast<Bytef*>(buf);
+        this->stream.avail_out = sizeof(buf);
+
+        const int ret = inflate(&this->stream, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        {
+            log_println(DEBUG, "inflate() failed: {}", this->stream.msg ? this->stream.msg : std::to_string(ret));
+            this->failed = true;
+            return false;
+        }
+
+        this->ended = ret == Z_STREAM_END;
+        if (!this->output(std::string_view(buf, sizeof(buf) - this->stream.avail_out)))
+        {
+            this->failed = true;
+            return false;
+        }
+    } while (this->stream.avail_in > 0 || this->stream.avail_out == 0);
+
+    return true;
+}
+
+/** Reads the ETag and Last-Modified headers of the last download of a file,
+ * to send them back as If-None-Match and If-Modified-Since.
+ * @param validators_path where writeValidators() stored them
+ */
+cpr::Header readValidators(const path& validators_path)
+{
+    cpr::Header   headers;
+    std::ifstream validators(validators_path);
+    std::string   etag, last_modified;
+
+    std::getline(validators, etag);
+    std::getline(validators, last_modified);
+
+    if (!etag.empty())
+        headers["If-None-Match"] = etag;
+    if (!last_modified.empty())
+        headers["If-Modified-Since"] = last_modified;
+
+    return headers;
+}
+
+void writeValidators(const path& validators_path, const cpr::Response& r)
+{
+    const auto& etag          = r.header.find("ETag");
+    const auto& last_modified = r.header.find("Last-Modified");
+
+    std::ofstream validators(validators_path, std::ios::trunc);
+    validators << (etag != r.header.end() ? etag->second : "") << '\n'
+               << (last_modified != r.header.end() ? last_modified->second : "") << '\n';
+}
+
+/* Writes the AUR package list to a temporary file while it downloads, inflating it if it's still gzip'd,
+ * and collects the names for the index on the way. Only a chunk and the line it ends in are held in memory.
+ */
+class AurListWriter
+{
+public:
+    AurIndexBuilder  index;
+    AtomicFileWriter file;
+
+    AurListWriter(const path& file_path) : file(file_path), decoder([this](const std::string_view data) { return this->output(data); }) {}
+
+    bool write(const std::string_view data) { return this->file.out.good() && this->decoder.write(data); }
+
+    // @return false if the list is incomplete or couldn't be written
+    bool finish()
+    {
+        if (!this->decoder.finish())
+            return false;
+
+        if (!this->line.empty())
+            this->index.add(this->line);
+
+        return this->file.out.good();
+    }
+
+private:
+    GzipDecoder decoder;
+    std::string line;
+
+    bool output(std::string_view data)
+    {
+        this->file.out.write(data.data(), data.size());
+
+        for (size_t pos; (pos = data.find('\n')) != data.npos; data.remove_prefix(pos + 1))
+        {
+            if (this->line.empty())
+                this->index.add(data.substr(0, pos));
+            else
+            {
+                this->line.append(data.substr(0, pos));
+                this->index.add(this->line);
+                this->line.clear();
+            }
+        }
+        this->line.append(data);
+
+        return this->file.out.good();
+    }
+};
+
+/** Downloads the AUR package list, unless it didn't change.
+ * The ETag and Last-Modified headers of the last download are stored in <file_path>.validators,
+ * and sent back as If-None-Match and If-Modified-Since, a 304 only updates the modification time of file_path.
+ * The list is streamed to a temporary file, then renamed over file_path once its index and changes are written,
+ * so other taur processes never read half of it.
+ */
+static bool download_aur_cache(const path& file_path, TaurBackend& backend)
 {
-    const cpr::Response& r = cpr::Get(cpr::Url{ AUR_URL "/packages.gz" });
+    const path& validators_path = file_path.string() + ".validators";
+    cpr::Header headers;
+
+    if (std::filesystem::exists(file_path))
+        headers = readValidators(validators_path);
+
+    AurListWriter writer(file_path);
+    if (!writer.file.out.is_open())
+        return false;
+
+    const cpr::Response& r =
+        backend.http_get(backend.aur_url() + "/packages.gz", headers, [&](const std::string_view data) { return writer.write(data); });
+    const bool complete = writer.finish();
 
-    if (r.status_code == 200)
+    std::error_code err;
+    if (r.status_code == 304)
+    {
+        log_println(DEBUG, "{} is up to date", file_path.string());
+        std::filesystem::last_write_time(file_path, std::filesystem::file_time_type::clock::now(), err);
+    }
+    else if (r.status_code == 200)
     {
-        std::ofstream outfile(file_path, std::ios::trunc);
-        if (!outfile.is_open())
+        if (!complete || r.error.code != cpr::ErrorCode::OK)
         {
-            log_println(ERROR, _("Failed to open/write {}"), file_path.c_str());
+            log_println(ERROR, _("Failed to download {}: {}"), r.url.str(), r.error.message.empty() ? _("corrupted or incomplete data") : r.error.message);
             return false;
         }
-        outfile << r.text;
+
+        // the index and the changes are derived from the list, so they're written first and the list is committed last.
+        // if taur stops in between, the old validators get the list downloaded again on the next refresh
+
+        // record what changed since the last refresh, when nothing did the index can stay as it is
+        const path& index_path    = config->cacheDir / "packages.idx";
+        bool        index_current = false;
+        {
+            const AurIndex previous(index_path);
+            if (previous.valid())
+            {
+                const AurIndexDiff_t& diff = writer.index.diff(previous);
+                log_println(DEBUG, "AUR package list refreshed, {} added and {} removed", diff.added.size(), diff.removed.size());
+
+                write_aur_changes(diff, config->cacheDir / "packages.changes");
+                index_current = diff.empty();
+            }
+        }
+
+        // without a matching index, aur_index() builds one from the list
+        if (!index_current && !writer.index.write(index_path))
+            std::filesystem::remove(index_path, err);
+
+        if (!writer.file.commit())
+        {
+            // the index may be ahead of the list now, have it rebuilt from the old one
+            if (!index_current)
+            {
+                std::filesystem::remove(index_path, err);
+                reload_aur_index();
+            }
+            return false;
+        }
+
+        if (!index_current)
+            reload_aur_index();
+
+        writeValidators(validators_path, r);
     }
     else
     {
@@ -838,17 +1078,23 @@ bool download_aur_cache(const path& file_path)
 // This function will automatically try again after downloading the file, if not already present.
 // Do not call this with true unless you do not want this behavior.
 // It is, by default, false.
-bool update_aur_cache(const bool recursiveCall)
+bool update_aur_cache(TaurBackend& backend, const bool recursiveCall)
 {
     const path& file_path = config->cacheDir / "packages.aur";
 
     struct stat file_stat;
     if (stat(file_path.c_str(), &file_stat) != 0)
     {
+        if (errno == ENOENT && config->offline)
+        {
+            log_println(ERROR, _("Offline, and {} was never downloaded"), file_path.string());
+            return false;
+        }
+
         if (errno == ENOENT && !recursiveCall)
         {  // file not found, download THEN try again once more.
             log_println(INFO, _("File {} not found, attempting download."), file_path.string());
-            return download_aur_cache(file_path) && update_aur_cache(true);
+            return download_aur_cache(file_path, backend) && update_aur_cache(backend, true);
         }
 
         log_println(ERROR, _("Unable to get {} metadata: {}"), file_path.string(), errno);
@@ -857,15 +1103,15 @@ bool update_aur_cache(const bool recursiveCall)
     }
 
     auto _current_time    = std::chrono::system_clock::now();
-    auto _timeoutDuration = std::chrono::hours(24 * 5);
+    auto _timeoutDuration = std::chrono::seconds(config->aurListMaxAge);
 
     auto        timeout    = std::chrono::duration_cast<std::chrono::seconds>(_timeoutDuration).count();
     std::time_t now_time_t = std::chrono::system_clock::to_time_t(_current_time);
 
-    if (file_stat.st_mtim.tv_sec < now_time_t - timeout)
+    if (file_stat.st_mtim.tv_sec <= now_time_t - timeout && !config->offline)
     {
         log_println(INFO, _("Refreshing {}"), file_path.string());
-        download_aur_cache(file_path);
+        download_aur_cache(file_path, backend);
     }
 
     return true;
@@ -887,6 +1133,37 @@ std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>
     }
     else if (pkgs.size() > 1)
     {
+        // while the user is choosing, look up the most popular AUR candidates (and clone the first one),
+        // so picking one of them doesn't have to wait on the AUR.
+        std::vector<const TaurPkg_t*> candidates;
+        for (const TaurPkg_t& pkg : pkgs)
+            if (!pkg.aur_url.empty())
+                candidates.push_back(&pkg);
+
+        const size_t prefetchCount = std::min<size_t>(candidates.size(), config->prefetchCandidates);
+        std::partial_sort(candidates.begin(), candidates.begin() + prefetchCount, candidates.end(),
+                          [](const TaurPkg_t* a, const TaurPkg_t* b) { return a->popularity > b->popularity; });
+
+        std::vector<std::string> prefetchNames;
+        for (size_t i = 0; i < prefetchCount; i++)
+            prefetchNames.push_back(candidates[i]->name);
+
+        // the lookup is remembered by the backend, so there's nothing to get out of it here.
+        // it's cancelled if none of them gets picked, and the thread is joined once we return
+        std::jthread      prefetchedInfo;
+        std::future<bool> prefetchedClone;
+        std::stop_source  cancelClone;
+        if (!prefetchNames.empty())
+        {
+            log_println(DEBUG, "prefetching {}", prefetchNames);
+            prefetchedInfo = std::jthread([&backend, prefetchNames, useGit](std::stop_token stop) {
+                backend.fetch_pkgs(prefetchNames, useGit, PKG_FIELDS_ALL, stop);
+            });
+            if (useGit)
+                prefetchedClone = backend.prefetch_git(AUR_URL_GIT(backend.aur_url(), prefetchNames.front()),
+                                                       config->cacheDir / prefetchNames.front(), cancelClone.get_token());
+        }
+
         log_println(INFO, _("TabAUR has found multiple packages relating to your search query, Please pick one."));
         std::string input;
         do
@@ -909,8 +1186,9 @@ std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>
 
         std::vector<std::string> indices = split(input, ' ');
 
-        std::vector<TaurPkg_t> output;
-        output.reserve(indices.size());
+        std::vector<size_t>      selectedIndices;
+        std::vector<std::string> aurPkgNames;
+        selectedIndices.reserve(indices.size());
 
         for (size_t i = 0; i < indices.size(); i++)
         {
@@ -919,9 +1197,46 @@ std::optional<std::vector<TaurPkg_t>> askUserForPkg(const std::vector<TaurPkg_t>
             if (selected >= pkgs.size())
                 continue;
 
-            output.push_back(pkgs[selected].aur_url.empty()
-                                 ? pkgs[selected]
-                                 : backend.fetch_pkg(pkgs[selected].name, useGit).value_or(pkgs[selected]));
+            selectedIndices.push_back(selected);
+            if (!pkgs[selected].aur_url.empty())
+                aurPkgNames.push_back(pkgs[selected].name);
+        }
+
+        const auto& isSelected = [&](const std::string& name) {
+            return std::find(aurPkgNames.begin(), aurPkgNames.end(), name) != aurPkgNames.end();
+        };
+        if (std::none_of(prefetchNames.begin(), prefetchNames.end(), isSelected))
+            prefetchedInfo.request_stop();
+
+        // fetch every selected AUR package at once, the prefetched ones are already known by now
+        const std::vector<TaurPkg_t>& aurPkgs = backend.fetch_pkgs_async(aurPkgNames, useGit).get();
+
+        // don't let the caller touch the clone while it's still being made,
+        // and don't wait on a clone nobody picked (or after CTRL-C), it gets killed and removed instead
+        if (prefetchedClone.valid())
+        {
+            if (net_interrupted || !isSelected(prefetchNames.front()))
+                cancelClone.request_stop();
+            prefetchedClone.wait();
+        }
+        exitIfInterrupted();
+
+        std::vector<TaurPkg_t> output;
+        output.reserve(selectedIndices.size());
+
+        for (const size_t selected : selectedIndices)
+        {
+            const TaurPkg_t& pkg = pkgs[selected];
+            if (pkg.aur_url.empty())
+            {
+                output.push_back(pkg);
+                continue;
+            }
+
+            const auto& fetched = std::find_if(aurPkgs.begin(), aurPkgs.end(),
+                                               [&pkg](const TaurPkg_t& element) { return element.name == pkg.name; });
+
+            output.push_back(fetched != aurPkgs.end() ? *fetched : pkg);
         }
 
         return output;
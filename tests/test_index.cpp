@@ -0,0 +1,217 @@
+#include "index.hpp"
+#include "config.hpp"
+#include "util.hpp"
+
+#include "catch2/catch_amalgamated.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <unistd.h>
+
+const std::string& configDir = getConfigDir();
+std::string configfile = (configDir + "/config.toml");
+std::string themefile  = (configDir + "/theme.toml");
+
+std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+// a packages.aur sized list, in the order the AUR gives it (unsorted, with its header)
+static std::vector<std::string> make_pkg_list(const path& list_path)
+{
+    std::vector<std::string> names;
+    std::ofstream list(list_path, std::ios::trunc);
+    list << "# AUR package list, generated on Fri, 01 Jan 2100 00:00:00 GMT\n";
+    for (int i = 100000; i > 0; i--)
+    {
+        names.push_back(fmt::format("pkg-{}{}", i * 7, i % 3 ? "-git" : ""));
+        list << names.back() << '\n';
+    }
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+TEST_CASE( "index.cpp test suitcase", "[Index]" ) {
+    const path& tmp = std::filesystem::temp_directory_path() / fmt::format("taur-test-index-{}", getpid());
+    std::filesystem::create_directories(tmp);
+    const std::vector<std::string>& names = make_pkg_list(tmp / "packages.aur");
+
+    REQUIRE(build_aur_index(tmp / "packages.aur", tmp / "packages.idx"));
+    AurIndex index(tmp / "packages.idx");
+
+    SECTION( "Lookups" ) {
+        REQUIRE(index.valid());
+        REQUIRE(index.size() == names.size());
+        REQUIRE(index.at(0) == names.front());
+        for (const std::string& name : names)
+            REQUIRE(index.contains(name));
+        REQUIRE_FALSE(index.contains("pkg-8"));
+        REQUIRE_FALSE(index.contains("# AUR package list"));
+        REQUIRE_FALSE(index.contains(""));
+    }
+
+    SECTION( "Diffs" ) {
+        AurIndexBuilder builder;
+        builder.add("aaa-new");
+        for (size_t i = 1; i < names.size(); i++)
+            builder.add(names[i]);
+
+        const AurIndexDiff_t& diff = builder.diff(index);
+        REQUIRE(diff.added == std::vector<std::string>{ "aaa-new" });
+        REQUIRE(diff.removed == std::vector<std::string>{ names.front() });
+
+        REQUIRE(write_aur_changes(diff, tmp / "packages.changes"));
+        const std::optional<AurIndexDiff_t>& changes = read_aur_changes(tmp / "packages.changes");
+        REQUIRE(changes.has_value());
+        REQUIRE(changes->added == diff.added);
+        REQUIRE(changes->removed == diff.removed);
+    }
+
+    SECTION( "Provides" ) {
+        AurProvidesBuilder builder;
+        builder.add("jdk17-bin", "java-runtime=17");
+        builder.add("jdk21-bin", "java-runtime=21");
+        builder.add("jre-minimal", "java-runtime");
+        builder.add("libfoo-git", "libfoo.so=1-64");
+        builder.add("libfoo-git", "libfoo-git");
+
+        REQUIRE(builder.write(tmp / "provides.idx"));
+        AurProvidesIndex provides(tmp / "provides.idx");
+        REQUIRE(provides.valid());
+        REQUIRE(provides.size() == 4);
+
+        REQUIRE(provides.providers("java-runtime") == std::vector<std::string_view>{ "jdk17-bin", "jdk21-bin", "jre-minimal" });
+        REQUIRE(provides.providers("java-runtime>=21") == std::vector<std::string_view>{ "jdk21-bin" });
+        REQUIRE(provides.providers("java-runtime<21") == std::vector<std::string_view>{ "jdk17-bin" });
+        REQUIRE(provides.providers("libfoo.so=1-64") == std::vector<std::string_view>{ "libfoo-git" });
+        REQUIRE(provides.providers("libfoo-git").empty());
+        REQUIRE(provides.providers("java").empty());
+    }
+
+    SECTION( "Metadata store" ) {
+        AurMetaBuilder builder;
+        builder.add({ .name = "zsh-git", .version = "5.9.r1-1", .url_path = "/cgit/aur.git/snapshot/zsh-git.tar.gz",
+                      .last_modified = 1700000000, .votes = 3, .depends = { "pcre2", "libcap" }, .makedepends = { "git" } });
+        builder.add({ .name = "aaa", .version = "1.0-1", .desc = "first", .maintainer = "someone", .popularity = 0.5f,
+                      .licenses = { "MIT" }, .depends = { "pcre2" } });
+        builder.add({ .name = "mid", .version = "2:3.0-2", .outofdate = 1700000001 });
+
+        REQUIRE(builder.write(tmp / "packages-meta.idx", 1234));
+        AurMetaStore store(tmp / "packages-meta.idx");
+        REQUIRE(store.valid());
+        REQUIRE(store.size() == 3);
+        REQUIRE(store.snapshot() == 1234);
+        REQUIRE_FALSE(store.find("zzz").has_value());
+
+        const std::optional<size_t>& aaa = store.find("aaa");
+        REQUIRE(aaa == 0);
+        REQUIRE(store.version(*aaa) == "1.0-1");
+        REQUIRE(store.desc(*aaa) == "first");
+        REQUIRE(store.maintainer(*aaa) == "someone");
+        REQUIRE(store.popularity(*aaa) == 0.5f);
+        REQUIRE(std::vector<std::string_view>(store.licenses(*aaa).begin(), store.licenses(*aaa).end()) == std::vector<std::string_view>{ "MIT" });
+
+        const std::optional<size_t>& mid = store.find("mid");
+        REQUIRE(mid.has_value());
+        REQUIRE(store.maintainer(*mid) == "\1");
+        REQUIRE(store.outofdate(*mid) == 1700000001);
+        REQUIRE(store.depends(*mid).size() == 0);
+
+        const std::optional<size_t>& zsh = store.find("zsh-git");
+        REQUIRE(zsh.has_value());
+        REQUIRE(store.url_path(*zsh) == "/cgit/aur.git/snapshot/zsh-git.tar.gz");
+        REQUIRE(store.last_modified(*zsh) == 1700000000);
+        REQUIRE(store.votes(*zsh) == 3);
+        REQUIRE(std::vector<std::string_view>(store.depends(*zsh).begin(), store.depends(*zsh).end()) ==
+                std::vector<std::string_view>{ "pcre2", "libcap" });
+        REQUIRE(std::vector<std::string_view>(store.makedepends(*zsh).begin(), store.makedepends(*zsh).end()) ==
+                std::vector<std::string_view>{ "git" });
+    }
+
+    SECTION( "Trigrams" ) {
+        TrigramIndexBuilder builder;
+        for (const std::string& name : names)
+            builder.add(name, { name, "An AUR package" });
+        builder.add("extra/Foo-Bar", { "Foo-Bar", "Terminal emulator" });
+
+        REQUIRE(builder.write(tmp / "search.tri", 42));
+        TrigramIndex trigrams(tmp / "search.tri");
+        REQUIRE(trigrams.valid());
+        REQUIRE(trigrams.docs() == names.size() + 1);
+        REQUIRE(trigrams.stamp() == 42);
+        REQUIRE(trigrams.doc_key(names.size()) == "extra/Foo-Bar");
+
+        REQUIRE_FALSE(trigrams.candidates("fo").has_value());
+        REQUIRE(trigrams.candidates("foo-bar") == std::vector<uint32_t>{ static_cast<uint32_t>(names.size()) });
+        REQUIRE(trigrams.candidates("TERMINAL") == std::vector<uint32_t>{ static_cast<uint32_t>(names.size()) });
+        REQUIRE(trigrams.candidates("xyzzy")->empty());
+
+        // the candidates are a superset of the matches, e.g "pkg-7-" has the trigrams of "pkg-77-git" but doesn't match it
+        const std::optional<std::vector<uint32_t>>& candidates = trigrams.candidates("pkg-7777");
+        REQUIRE(candidates.has_value());
+        for (uint32_t doc = 0; doc < names.size(); doc++)
+            if (names[doc].find("pkg-7777") != std::string::npos)
+                REQUIRE(std::binary_search(candidates->begin(), candidates->end(), doc));
+        REQUIRE(trigrams.candidates("an aur package")->size() == names.size());
+    }
+
+    std::filesystem::remove_all(tmp);
+}
+
+// hidden, run it with `./test_index "[.benchmark]"`
+TEST_CASE( "index.cpp lookup benchmark", "[.benchmark]" ) {
+    const path& tmp = std::filesystem::temp_directory_path() / fmt::format("taur-bench-index-{}", getpid());
+    std::filesystem::create_directories(tmp);
+    const std::vector<std::string>& names = make_pkg_list(tmp / "packages.aur");
+
+    REQUIRE(build_aur_index(tmp / "packages.aur", tmp / "packages.idx"));
+    AurIndex index(tmp / "packages.idx");
+
+    // half hits, half misses, like the depends of a package
+    std::vector<std::string> probes;
+    for (size_t i = 0; i < 256; i++)
+        probes.push_back(i % 2 ? names[(i * 7919) % names.size()] : fmt::format("lib{}", i));
+
+    BENCHMARK( "std::binary_search over std::vector<std::string>" ) {
+        size_t found = 0;
+        for (const std::string& probe : probes)
+            found += std::binary_search(names.begin(), names.end(), probe);
+        return found;
+    };
+
+    BENCHMARK( "AurIndex::contains_sorted" ) {
+        size_t found = 0;
+        for (const std::string& probe : probes)
+            found += index.contains_sorted(probe);
+        return found;
+    };
+
+    BENCHMARK( "AurIndex::contains (perfect hash)" ) {
+        size_t found = 0;
+        for (const std::string& probe : probes)
+            found += index.contains(probe);
+        return found;
+    };
+
+    TrigramIndexBuilder builder;
+    for (const std::string& name : names)
+        builder.add({}, { name });
+    REQUIRE(builder.write(tmp / "search.tri", 0));
+    TrigramIndex trigrams(tmp / "search.tri");
+
+    BENCHMARK( "substring search, scanning every name" ) {
+        size_t found = 0;
+        for (const std::string& name : names)
+            found += name.find("777-git") != std::string::npos;
+        return found;
+    };
+
+    BENCHMARK( "substring search, through the trigram index" ) {
+        size_t found = 0;
+        for (const uint32_t doc : *trigrams.candidates("777-git"))
+            found += names[doc].find("777-git") != std::string::npos;
+        return found;
+    };
+
+    std::filesystem::remove_all(tmp);
+}
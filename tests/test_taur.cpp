@@ -1,9 +1,186 @@
-#include <memory>
+#include "taur.hpp"
 #include "config.hpp"
 #include "util.hpp"
 
+#include "catch2/catch_amalgamated.hpp"
+
+#include <memory>
+#include <span>
+
 const std::string& configDir = getConfigDir();
 std::string configfile = (configDir + "/config.toml");
 std::string themefile  = (configDir + "/theme.toml");
 
 std::unique_ptr<Config> config = std::make_unique<Config>(configfile, themefile, configDir);
+
+TEST_CASE( "taur.cpp test suitcase", "[Taur]" ) {
+    const std::string base = "https://aur.archlinux.org/rpc/v5/info?";
+    std::vector<size_t> sizes;
+
+    SECTION( "Info url chunks" ) {
+        // "arg%5B%5D=a" is 11 characters, and every name after the first one adds a '&'
+        const std::vector<std::string> pkgs = { "a", "b" };
+        REQUIRE(splitInfoUrls(base, pkgs, base.size() + 23, sizes) == std::vector<std::string>{ base + "arg%5B%5D=a&arg%5B%5D=b" });
+        REQUIRE(sizes == std::vector<size_t>{ 2 });
+
+        REQUIRE(splitInfoUrls(base, pkgs, base.size() + 22, sizes) ==
+                std::vector<std::string>{ base + "arg%5B%5D=a", base + "arg%5B%5D=b" });
+        REQUIRE(sizes == std::vector<size_t>{ 1, 1 });
+
+        REQUIRE(splitInfoUrls(base, {}, base.size() + 22, sizes).empty());
+        REQUIRE(sizes.empty());
+    }
+
+    SECTION( "Info url chunks, encoded names" ) {
+        // the encoded length is what counts, "c++" is "c%2B%2B"
+        const std::vector<std::string>& urls = splitInfoUrls(base, { "c++", "d" }, base.size() + 29, sizes);
+        REQUIRE(urls == std::vector<std::string>{ base + "arg%5B%5D=c%2B%2B&arg%5B%5D=d" });
+        REQUIRE(splitInfoUrls(base, { "c++", "d" }, base.size() + 28, sizes).size() == 2);
+    }
+
+    SECTION( "Info url chunks, a name longer than the limit" ) {
+        const std::string               name(100, 'x');
+        const std::vector<std::string>& urls = splitInfoUrls(base, { "a", name, "b" }, base.size() + 50, sizes);
+        REQUIRE(urls == std::vector<std::string>{ base + "arg%5B%5D=a", base + "arg%5B%5D=" + name, base + "arg%5B%5D=b" });
+        REQUIRE(sizes == std::vector<size_t>{ 1, 1, 1 });
+    }
+
+    SECTION( "Info url chunks, many names" ) {
+        std::vector<std::string> pkgs;
+        for (int i = 0; i < 1000; i++)
+            pkgs.push_back(fmt::format("pkg-{}", i));
+
+        const size_t                    maxLen = 512;
+        const std::vector<std::string>& urls   = splitInfoUrls(base, pkgs, maxLen, sizes);
+        size_t                          total  = 0, next = 0;
+        for (size_t i = 0; i < urls.size(); i++)
+        {
+            REQUIRE(urls[i].size() <= maxLen);
+            total += sizes[i];
+
+            // every name is there once, in order
+            for (const std::string_view arg : split(urls[i].substr(base.size()), '&'))
+                REQUIRE(arg == "arg%5B%5D=" + pkgs[next++]);
+        }
+        REQUIRE(total == pkgs.size());
+        REQUIRE(next == pkgs.size());
+
+        // and the first name of the next chunk wouldn't have fit in the previous one
+        for (size_t i = 0, first = 0; i + 1 < urls.size(); i++)
+        {
+            first += sizes[i];
+            REQUIRE(urls[i].size() + "&arg%5B%5D="_len + pkgs[first].size() > maxLen);
+        }
+    }
+}
+
+// two packages, with escapes in the strings and every kind of field
+static const std::string rpc_response = R"({"resultcount":2,"results":[)"
+    R"({"Name":"foo-git","Version":"1.2.r3-1","Description":"A \"quoted\" caf\u00e9\nline","URL":"https:\/\/foo.org",)"
+    R"("URLPath":"/cgit/aur.git/snapshot/foo-git.tar.gz","Maintainer":null,"LastModified":1700000000,"OutOfDate":null,)"
+    R"("Popularity":0.25,"NumVotes":42,"Depends":["glibc","bar>=2"],"MakeDepends":["git"],"License":["MIT","custom:\u2603"]},)"
+    R"({"Name":"bar","Version":"2-1","Description":"\\back\\slash","URLPath":"/cgit/aur.git/snapshot/bar.tar.gz",)"
+    R"("Maintainer":"someone","LastModified":1600000000,"OutOfDate":1650000000,"Popularity":0,"NumVotes":0}],)"
+    R"("type":"multiinfo","version":5})";
+
+static void check_full_pkgs(const RpcResult_t& result)
+{
+    REQUIRE(result.status_code == 200);
+    REQUIRE(result.type == "multiinfo");
+    REQUIRE(result.pkgs.size() == 2);
+
+    const TaurPkg_t& foo = result.pkgs[0];
+    REQUIRE(foo.name == "foo-git");
+    REQUIRE(foo.version == "1.2.r3-1");
+    REQUIRE(foo.desc == "A \"quoted\" caf\u00e9\nline");
+    REQUIRE(foo.url == "https://foo.org");
+    REQUIRE(foo.aur_url == "https://aur.archlinux.org/cgit/aur.git/snapshot/foo-git.tar.gz");
+    REQUIRE(foo.maintainer == "\1");
+    REQUIRE(foo.last_modified == 1700000000);
+    REQUIRE(foo.popularity == 0.25f);
+    REQUIRE(foo.votes == 42);
+    REQUIRE(foo.depends == std::vector<std::string>{ "glibc", "bar>=2" });
+    REQUIRE(foo.makedepends == std::vector<std::string>{ "git" });
+    REQUIRE(foo.totaldepends == std::vector<std::string>{ "glibc", "bar>=2", "git" });
+    REQUIRE(foo.licenses == std::vector<std::string>{ "MIT", "custom:\u2603" });
+
+    const TaurPkg_t& bar = result.pkgs[1];
+    REQUIRE(bar.name == "bar");
+    REQUIRE(bar.desc == "\\back\\slash");
+    REQUIRE(bar.maintainer == "someone");
+    REQUIRE(bar.outofdate == 1650000000);
+    REQUIRE(bar.depends.empty());
+}
+
+TEST_CASE( "taur.cpp rpc parsing", "[Taur]" ) {
+    const std::string base_url = "https://aur.archlinux.org";
+
+    SECTION( "Split in two, at every byte" ) {
+        // this covers splits in the middle of keys, strings, escapes (\" \\ \/ \u00e9) and numbers
+        for (size_t i = 0; i <= rpc_response.size(); i++)
+        {
+            const std::string_view            response = rpc_response;
+            const std::vector<std::string_view> chunks = { response.substr(0, i), response.substr(i) };
+            check_full_pkgs(parseRpcChunks(chunks, false, PKG_FIELDS_ALL, base_url));
+        }
+    }
+
+    SECTION( "A byte at a time" ) {
+        std::vector<std::string_view> chunks;
+        for (size_t i = 0; i < rpc_response.size(); i++)
+            chunks.push_back(std::string_view(rpc_response).substr(i, 1));
+        check_full_pkgs(parseRpcChunks(chunks, false, PKG_FIELDS_ALL, base_url));
+    }
+
+    SECTION( "Projected fields" ) {
+        const std::vector<std::string_view> chunks = { std::string_view(rpc_response).substr(0, 77), std::string_view(rpc_response).substr(77) };
+        const RpcResult_t& result = parseRpcChunks(chunks, true, PKG_FIELDS_UPGRADE_CHECK, base_url);
+        REQUIRE(result.pkgs.size() == 2);
+
+        const TaurPkg_t& foo = result.pkgs[0];
+        REQUIRE(foo.name == "foo-git");
+        REQUIRE(foo.version == "1.2.r3-1");
+        REQUIRE(foo.aur_url == "https://aur.archlinux.org/foo-git.git");
+        REQUIRE(foo.last_modified == 1700000000);
+        REQUIRE(foo.desc.empty());
+        REQUIRE(foo.url.empty());
+        REQUIRE(foo.maintainer == "\1");
+        REQUIRE(foo.votes == 0);
+        REQUIRE(foo.depends.empty());
+        REQUIRE(foo.licenses.empty());
+        REQUIRE(foo.totaldepends.empty());
+    }
+
+    SECTION( "Truncated" ) {
+        const std::vector<std::string_view> chunks = { std::string_view(rpc_response).substr(0, rpc_response.size() / 2) };
+        REQUIRE(parseRpcChunks(chunks, false, PKG_FIELDS_ALL, base_url).status_code == 0);
+        REQUIRE(parseRpcChunks({}, false, PKG_FIELDS_ALL, base_url).status_code == 0);
+    }
+
+    SECTION( "In place" ) {
+        RpcView_t view{ .buffer = std::make_unique<std::string>(rpc_response) };
+        REQUIRE(parseRpcView(view));
+        REQUIRE(view.type == "multiinfo");
+        REQUIRE(view.pkgs.size() == 2);
+
+        const TaurPkgView_t& foo = view.pkgs[0];
+        REQUIRE(foo.name == "foo-git");
+        REQUIRE(foo.desc == "A \"quoted\" caf\u00e9\nline");
+        REQUIRE(foo.url == "https://foo.org");
+        REQUIRE(foo.url_path == "/cgit/aur.git/snapshot/foo-git.tar.gz");
+        REQUIRE(foo.maintainer == "\1");
+        REQUIRE(foo.votes == 42);
+        REQUIRE(std::vector<std::string_view>(foo.depends.begin(), foo.depends.end()) == std::vector<std::string_view>{ "glibc", "bar>=2" });
+        REQUIRE(std::vector<std::string_view>(foo.makedepends.begin(), foo.makedepends.end()) == std::vector<std::string_view>{ "git" });
+        REQUIRE(std::vector<std::string_view>(foo.licenses.begin(), foo.licenses.end()) == std::vector<std::string_view>{ "MIT", "custom:\u2603" });
+
+        const TaurPkgView_t& bar = view.pkgs[1];
+        REQUIRE(bar.desc == "\\back\\slash");
+        REQUIRE(bar.depends.empty());
+        REQUIRE(bar.licenses.empty());
+
+        RpcView_t broken{ .buffer = std::make_unique<std::string>(rpc_response.substr(0, 100)) };
+        REQUIRE_FALSE(parseRpcView(broken));
+        REQUIRE(broken.pkgs.empty());
+    }
+}
@@ -29,3 +29,98 @@ TEST_CASE( "util.cpp test suitcase", "[Util]" ) {
         REQUIRE(shell_exec("echo hello") == "hello");
     }
 }
+
+// gzip's data, as a single member
+static std::string gzip(const std::string_view data)
+{
+    z_stream stream{};
+    deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in  = data.size();
+    stream.next_out  = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+// decodes data handed to a GzipDecoder in chunks of chunkSize bytes, nullopt if it failed
+static std::optional<std::string> gunzip(const std::string_view data, const size_t chunkSize)
+{
+    std::string out;
+    GzipDecoder decoder([&](const std::string_view chunk) {
+        out.append(chunk);
+        return true;
+    });
+
+    for (size_t i = 0; i < data.size(); i += chunkSize)
+        if (!decoder.write(data.substr(i, chunkSize)))
+            return {};
+
+    if (!decoder.finish())
+        return {};
+
+    return out;
+}
+
+TEST_CASE( "util.cpp gzip decoding", "[Util]" ) {
+    std::string text;
+    for (int i = 0; i < 20000; i++)
+        text += fmt::format("package-{}\n", i * 7919 % 100000);
+
+    const std::string& member = gzip(text);
+
+    SECTION( "Split chunks" ) {
+        for (const size_t chunkSize : { 1, 2, 3, 7, 512, 65536 })
+            REQUIRE(gunzip(member, chunkSize) == text);
+        REQUIRE(gunzip(member, member.size()) == text);
+    }
+
+    SECTION( "Not gzip'd" ) {
+        REQUIRE(gunzip("plain text", 1) == "plain text");
+        REQUIRE(gunzip("x", 1) == "x");
+        REQUIRE(gunzip("", 1) == "");
+    }
+
+    SECTION( "Truncated" ) {
+        REQUIRE_FALSE(gunzip(std::string_view(member).substr(0, member.size() / 2), 512));
+        // the trailer with the CRC and the size is missing
+        REQUIRE_FALSE(gunzip(std::string_view(member).substr(0, member.size() - 4), 512));
+        REQUIRE_FALSE(gunzip(std::string_view(member).substr(0, 10), 1));
+    }
+
+    SECTION( "Corrupt" ) {
+        std::string corrupt = member;
+        corrupt[corrupt.size() / 2] ^= 0x55;
+        REQUIRE_FALSE(gunzip(corrupt, 512));
+
+        // the CRC doesn't match
+        corrupt = member;
+        corrupt[corrupt.size() - 8] ^= 0x01;
+        REQUIRE_FALSE(gunzip(corrupt, 512));
+    }
+
+    SECTION( "Concatenated members" ) {
+        const std::string& members = gzip("first\n") + gzip("") + gzip(text);
+        for (const size_t chunkSize : { 1, 5, 4096 })
+            REQUIRE(gunzip(members, chunkSize) == "first\n" + text);
+
+        // the second member is cut short
+        REQUIRE_FALSE(gunzip(std::string_view(members).substr(0, members.size() - 100), 4096));
+    }
+
+    SECTION( "Output callback stops it" ) {
+        size_t      calls = 0;
+        GzipDecoder decoder([&](const std::string_view) { return ++calls < 2; });
+        bool        ok = true;
+        for (size_t i = 0; i < member.size() && ok; i += 64)
+            ok = decoder.write(std::string_view(member).substr(i, 64));
+
+        REQUIRE_FALSE(ok);
+        REQUIRE_FALSE(decoder.write("more"));
+    }
+}